@@ -0,0 +1,181 @@
+// 화면 그리기 벤치마크
+// draw_editor_row 의 두 방식을 같은 화면으로 비교한다.
+//   per-char : 예전처럼 글자마다 mvwaddch (테두리/줄 지우기도 따로)
+//   per-row  : 지금처럼 한 줄을 chtype 버퍼에 색까지 모아 mvwaddchnstr 한 번
+// 파일(기본 main.c)을 C 문법으로 강조해 COLS x ROWS 화면을 채우고, 한 줄씩 밀어 가며
+// FRAMES 번 그린다. 두 방식을 번갈아 ROUNDS 번 재서 가장 빠른 값을 적는다.
+// 터미널 출력은 /dev/null 로 보낸다 (TERM 이 없으면 xterm-256color).
+// 사용법: ./bench_draw [파일]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "grammar.h"
+
+#define COLS_W 200
+#define ROWS_H 58
+#define FRAMES 1000
+#define ROUNDS 5
+
+struct row {
+    char* text;
+    int len;
+    struct hl_span* spans;
+    int nspans;
+};
+
+static WINDOW* editor_win;
+static chtype row_cells[COLS_W + 2];
+
+static chtype token_color(int kind) {
+    switch (kind) {
+        case HL_STRING:
+        case HL_PREPROC: return COLOR_PAIR(5);
+        case HL_COMMENT: return COLOR_PAIR(6);
+        case HL_PUNCT: return COLOR_PAIR(7);
+        case HL_KEYWORD: return COLOR_PAIR(8);
+        case HL_TYPE: return COLOR_PAIR(9);
+    }
+    return 0;
+}
+
+static chtype text_cell(unsigned char c) {
+    if (c == '\t') return ' ';
+    if (c < 32 || c >= 127) return (unsigned char)unctrl(c)[0];
+    return c;
+}
+
+// 예전 draw_editor_row (줄 번호 켠 상태)
+static void draw_per_char(int y, const struct row* r, int buf_line) {
+    mvwaddch(editor_win, y + 1, 0, ACS_VLINE);
+    wclrtoeol(editor_win);
+    mvwaddch(editor_win, y + 1, COLS_W + 1, ACS_VLINE);
+    mvwprintw(editor_win, y + 1, 1, "%3d", buf_line + 1);
+    mvwaddch(editor_win, y + 1, 4, ACS_VLINE);
+
+    int s = 0, x = 5;
+    for (int i = 0; i < r->len && x <= COLS_W; i++, x++) {
+        while (s < r->nspans && r->spans[s].start + r->spans[s].len <= (unsigned)i) s++;
+        chtype color = s < r->nspans && r->spans[s].start <= (unsigned)i ? token_color(r->spans[s].kind) : 0;
+        mvwaddch(editor_win, y + 1, x, (unsigned char)r->text[i] | color);
+    }
+}
+
+// 지금의 draw_editor_row (줄 번호 켠 상태)
+static void draw_per_row(int y, const struct row* r, int buf_line) {
+    chtype* cells = row_cells;
+    cells[0] = ACS_VLINE;
+    for (int x = 1; x <= COLS_W; x++) cells[x] = ' ';
+    cells[COLS_W + 1] = ACS_VLINE;
+
+    char number[16];
+    snprintf(number, sizeof(number), "%3d", buf_line + 1);
+    for (int i = 0; number[i]; i++) cells[i + 1] = number[i];
+    cells[4] = ACS_VLINE;
+
+    int s = 0, x = 5;
+    for (int i = 0; i < r->len && x <= COLS_W; i++, x++) {
+        while (s < r->nspans && r->spans[s].start + r->spans[s].len <= (unsigned)i) s++;
+        chtype color = s < r->nspans && r->spans[s].start <= (unsigned)i ? token_color(r->spans[s].kind) : 0;
+        cells[x] = text_cell(r->text[i]) | color;
+    }
+    mvwaddchnstr(editor_win, y + 1, 0, cells, COLS_W + 2);
+}
+
+// 파일을 줄로 나누고 C 문법으로 강조해 둔다
+static struct row* load_rows(const char* path, int* count) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return NULL;
+    const grammar* g = grammar_for_path(NULL);
+    struct row* rows = NULL;
+    int n = 0, cap = 0, state = 0;
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_cap, fp)) >= 0) {
+        if (len > 0 && line[len - 1] == '\n') len--;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            struct row* p = realloc(rows, cap * sizeof(*p));
+            if (!p) break;
+            rows = p;
+        }
+        struct span_buf spans = {0};
+        state = grammar_lex(g, line, len, state, &spans);
+        if (state < 0) state = 0;
+        rows[n].text = strndup(line, len);
+        rows[n].len = len;
+        rows[n].spans = spans.items;
+        rows[n].nspans = spans.n;
+        n++;
+    }
+    free(line);
+    fclose(fp);
+    *count = n;
+    return rows;
+}
+
+static double run(void (*draw)(int, const struct row*, int), const struct row* rows, int nrows, int refresh) {
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (int f = 0; f < FRAMES; f++) {
+        int top = f % nrows;
+        for (int y = 0; y < ROWS_H; y++) {
+            int line = (top + y) % nrows;
+            draw(y, &rows[line], line);
+        }
+        if (refresh) wrefresh(editor_win);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / 1e3 / FRAMES;
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "main.c";
+    int nrows;
+    struct row* rows = load_rows(path, &nrows);
+    if (!rows || nrows == 0) {
+        fprintf(stderr, "%s: no lines to draw\n", path);
+        return 1;
+    }
+
+    // 화면 크기는 터미널과 무관하게 고정한다
+    char lines_env[16], cols_env[16];
+    snprintf(lines_env, sizeof(lines_env), "%d", ROWS_H + 2);
+    snprintf(cols_env, sizeof(cols_env), "%d", COLS_W + 2);
+    setenv("LINES", lines_env, 1);
+    setenv("COLUMNS", cols_env, 1);
+    if (!getenv("TERM")) setenv("TERM", "xterm-256color", 1);
+    FILE* out = fopen("/dev/null", "w");
+    if (!out || !newterm(NULL, out, stdin)) {
+        fprintf(stderr, "cannot set up a headless terminal\n");
+        return 1;
+    }
+    start_color();
+    use_default_colors();
+    init_pair(5, COLOR_YELLOW, -1);
+    init_pair(6, COLOR_GREEN, -1);
+    init_pair(7, COLOR_RED, -1);
+    init_pair(8, COLOR_MAGENTA, -1);
+    init_pair(9, COLOR_CYAN, -1);
+    editor_win = newwin(ROWS_H + 2, COLS_W + 2, 0, 0);
+
+    // [방식][wrefresh 여부]
+    void (*draw[2])(int, const struct row*, int) = {draw_per_char, draw_per_row};
+    double best[2][2] = {{0}};
+    for (int round = 0; round < ROUNDS; round++)
+        for (int refresh = 0; refresh < 2; refresh++)
+            for (int k = 0; k < 2; k++) {
+                double t = run(draw[k], rows, nrows, refresh);
+                if (round == 0 || t < best[k][refresh]) best[k][refresh] = t;
+            }
+    endwin();
+
+    printf("draw: %dx%d screen of %s (%d lines), %d frames x %d rounds, TERM=%s\n",
+           COLS_W, ROWS_H, path, nrows, FRAMES, ROUNDS, getenv("TERM"));
+    printf("  per-char mvwaddch     %7.1f us/screen  with wrefresh %7.1f us\n", best[0][0], best[0][1]);
+    printf("  per-row mvwaddchnstr  %7.1f us/screen  with wrefresh %7.1f us\n", best[1][0], best[1][1]);
+    return 0;
+}
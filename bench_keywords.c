@@ -0,0 +1,144 @@
+// 키워드 분류기 벤치마크
+// mkkeywords 가 만든 keyword_class 와, 그 전에 main.c/ne.c 가 쓰던 목록 선형 탐색
+// (is_cyan_keyword/is_magenta_keyword 를 strcmp 로 차례로 훑기)을 같은 단어들로 비교한다.
+// 단어는 주어진 파일들(기본: 현재 디렉터리의 *.c *.h)에서 뽑은 식별자 전부이고,
+// 두 방식의 분류가 모두 같은지도 확인한다.
+// 사용법: ./bench_keywords [파일 ...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <glob.h>
+
+#include "keywords.h"
+
+#define PASSES 200
+
+// 예전 main.c 의 목록 그대로 (keywords.txt 의 [c cpp] 절과 같다)
+static const char* cyan_keywords[] = {"int", "double", "float", "enum", "char", "short", "long", "malloc", "free", "calloc", "realloc", NULL};
+static const char* magenta_keywords[] = {"void", "unsigned", "signed", "sizeof", "typedef", "struct", "union", "extern", "static", "const",
+                                         "if", "else", "switch", "case", "default", "while", "for", "do", "continue", "break", "return", NULL};
+
+static int is_cyan_keyword(const char* word) {
+    for (int i = 0; cyan_keywords[i] != NULL; i++) {
+        if (strcmp(word, cyan_keywords[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int is_magenta_keyword(const char* word) {
+    for (int i = 0; magenta_keywords[i] != NULL; i++) {
+        if (strcmp(word, magenta_keywords[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// 예전 classify_keyword: 단어를 NUL 로 끝나는 버퍼에 옮긴 뒤 두 목록을 훑는다
+static int classify_linear(const char* word, size_t len) {
+    char buf[64];
+    if (len >= sizeof(buf)) return KW_NONE;
+    memcpy(buf, word, len);
+    buf[len] = '\0';
+    if (is_cyan_keyword(buf)) return KW_TYPE;
+    if (is_magenta_keyword(buf)) return KW_KEYWORD;
+    return KW_NONE;
+}
+
+static int classify_generated(const char* word, size_t len) {
+    return keyword_class(word, len, KW_LANG_C);
+}
+
+struct word {
+    const char* text;
+    size_t len;
+};
+
+struct words {
+    struct word* list;
+    size_t count, cap;
+};
+
+// path 의 식별자들을 words 에 더한다. 파일 내용은 끝날 때까지 놓지 않는다
+static int collect(const char* path, struct words* w) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    size_t cap = 4096, len = 0, got;
+    char* data = malloc(cap);
+    while (data && (got = fread(data + len, 1, cap - len, fp)) > 0) {
+        len += got;
+        if (len == cap) {
+            char* p = realloc(data, cap * 2);
+            if (!p) free(data);
+            data = p;
+            cap *= 2;
+        }
+    }
+    fclose(fp);
+    if (!data) return -1;
+
+    for (size_t i = 0; i < len;) {
+        if (!isalpha((unsigned char)data[i]) && data[i] != '_') {
+            i++;
+            continue;
+        }
+        size_t j = i;
+        while (j < len && (isalnum((unsigned char)data[j]) || data[j] == '_')) j++;
+        if (w->count == w->cap) {
+            size_t n = w->cap ? w->cap * 2 : 1024;
+            struct word* p = realloc(w->list, n * sizeof(*p));
+            if (!p) return -1;
+            w->list = p;
+            w->cap = n;
+        }
+        w->list[w->count].text = data + i;
+        w->list[w->count].len = j - i;
+        w->count++;
+        i = j;
+    }
+    return 0;
+}
+
+static double time_ns(int (*classify)(const char*, size_t), struct words* w, long* sink) {
+    struct timespec a, b;
+    long sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (int pass = 0; pass < PASSES; pass++)
+        for (size_t i = 0; i < w->count; i++) sum += classify(w->list[i].text, w->list[i].len);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    *sink += sum;
+    return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / ((double)PASSES * w->count);
+}
+
+int main(int argc, char** argv) {
+    struct words w = {0};
+    glob_t g = {0};
+    int files = 0;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) files += collect(argv[i], &w) == 0;
+    } else if (glob("*.c", 0, NULL, &g) == 0) {
+        glob("*.h", GLOB_APPEND, NULL, &g);
+        for (size_t i = 0; i < g.gl_pathc; i++) files += collect(g.gl_pathv[i], &w) == 0;
+        globfree(&g);
+    }
+    if (w.count == 0) {
+        fprintf(stderr, "no identifiers to classify\n");
+        return 1;
+    }
+
+    size_t differ = 0, keywords = 0;
+    for (size_t i = 0; i < w.count; i++) {
+        int kind = classify_generated(w.list[i].text, w.list[i].len);
+        differ += kind != classify_linear(w.list[i].text, w.list[i].len);
+        keywords += kind != KW_NONE;
+    }
+
+    long sink = 0;
+    double linear = time_ns(classify_linear, &w, &sink);
+    double generated = time_ns(classify_generated, &w, &sink);
+    printf("keywords: %zu words from %d files (%zu keywords) x %d passes\n", w.count, files, keywords, PASSES);
+    printf("  linear scan %6.1f ns/word  generated %6.1f ns/word  (%.1fx)  mismatches %zu\n",
+           linear, generated, linear / generated, differ);
+    return differ != 0 || sink < 0;
+}
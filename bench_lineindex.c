@@ -0,0 +1,184 @@
+// 개행 색인 벤치마크
+// 같은 파일(평균 80바이트쯤의 줄)을 두고 line_index_scan 의 구현들과 예전 로더들을 비교한다.
+//   memchr/sse2/avx2/neon : mmap 한 파일을 doc_open 처럼 색인 페이지 단위로 훑는다
+//   fgets                 : 처음 main.c 의 로더 (MAX_COLS 버퍼에 한 줄씩 fgets)
+//   read1                 : ne.c 의 로더 (read(fd, &ch, 1) 로 한 바이트씩)
+// read1 은 너무 느려서 앞 READ1_MAX 바이트만 재고 전체 크기로 늘려 적는다 ('~' 표시).
+// 사용법: ./bench_lineindex [MB ...]   (기본 1 100 1024, 파일은 $TMPDIR 에 만들고 지운다)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// 구현을 하나씩 부르려고 커널을 그대로 가져온다
+#include "lineindex.c"
+
+#define NL_PAGE 4096            // document.c 의 색인 페이지 크기
+#define MAX_COLS 256            // 예전 main.c 의 줄 버퍼
+#define READ1_MAX (16L * 1024 * 1024)
+#define RUNS 3
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// 길이가 조금씩 다른 줄로 size 바이트짜리 파일을 만든다
+static int make_input(const char* path, size_t size) {
+    static const char words[] = "int main(void) { return strlen(name) + count * 2; } // comment text ";
+    FILE* fp = fopen(path, "w");
+    if (!fp) return -1;
+    unsigned seed = 1;
+    size_t written = 0;
+    char line[MAX_COLS];
+    while (written < size) {
+        seed = seed * 1103515245 + 12345;
+        size_t len = 40 + (seed >> 16) % 80;    // 40~119 바이트
+        if (len > size - written) len = size - written;
+        for (size_t i = 0; i < len; i++) line[i] = words[(i + (seed >> 8)) % (sizeof(words) - 1)];
+        line[len - 1] = '\n';
+        if (fwrite(line, 1, len, fp) != len) {
+            fclose(fp);
+            return -1;
+        }
+        written += len;
+    }
+    return fclose(fp);
+}
+
+// 커널 하나로 data 전체를 색인한다. 페이지가 차면 다음 페이지로 넘어가는 것까지 block_scan 과 같다
+static size_t index_with(scan_fn scan, const char* data, size_t size) {
+    static uint32_t page[NL_PAGE];
+    size_t from = 0, count = 0;
+    int crlf = 0;
+    while (from < size) {
+        size_t slot = count % NL_PAGE;
+        count += scan(data, from, size, page + slot, NL_PAGE - slot, &from, &crlf);
+    }
+    return count;
+}
+
+static long load_fgets(const char* path) {
+    char row[MAX_COLS];
+    long rows = 0;
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    while (fgets(row, MAX_COLS, fp)) {
+        row[strcspn(row, "\n")] = '\0';
+        rows++;
+    }
+    fclose(fp);
+    return rows;
+}
+
+// 줄 버퍼에 옮겨 담는 일은 read 호출 비용에 묻히므로 줄 길이만 센다
+static long load_read1(const char* path, size_t limit) {
+    size_t idx = 0, total = 0;
+    long rows = 0;
+    char ch;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    while (total < limit && read(fd, &ch, 1) > 0) {
+        total++;
+        if (ch == '\n' || idx >= MAX_COLS - 1) {
+            rows++;
+            idx = 0;
+        } else {
+            idx++;
+        }
+    }
+    close(fd);
+    return rows;
+}
+
+static void bench_size(const char* dir, size_t mb) {
+    char path[4096];
+    size_t size = mb * 1024 * 1024;
+    if (size == 0) return;
+    snprintf(path, sizeof(path), "%s/bench_lineindex.%d", dir, (int)getpid());
+    if (make_input(path, size) < 0) {
+        perror(path);
+        unlink(path);
+        return;
+    }
+
+    struct {
+        const char* name;
+        scan_fn scan;
+    } kernels[4];
+    int nk = 0;
+    kernels[nk].name = "memchr";
+    kernels[nk++].scan = scan_scalar;
+#if defined(LINEINDEX_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels[nk].name = "sse2";
+        kernels[nk++].scan = scan_sse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[nk].name = "avx2";
+        kernels[nk++].scan = scan_avx2;
+    }
+#elif defined(LINEINDEX_NEON)
+    kernels[nk].name = "neon";
+    kernels[nk++].scan = scan_neon;
+#endif
+
+    int fd = open(path, O_RDONLY);
+    char* data = fd < 0 ? MAP_FAILED : mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        unlink(path);
+        return;
+    }
+
+    // 커널들은 페이지 캐시에 올라온 매핑을 훑는다 (첫 회는 페이지 폴트까지 세므로 버린다)
+    printf("%5zu MB", mb);
+    size_t lines = index_with(scan_scalar, data, size);
+    for (int k = 0; k < nk; k++) {
+        double best = 0;
+        for (int r = 0; r < RUNS; r++) {
+            double t = now_ms();
+            if (index_with(kernels[k].scan, data, size) != lines) {
+                printf("  %s: line count mismatch\n", kernels[k].name);
+                break;
+            }
+            t = now_ms() - t;
+            if (r == 0 || t < best) best = t;
+        }
+        printf("  %s %9.1f ms", kernels[k].name, best);
+    }
+    munmap(data, size);
+    close(fd);
+
+    double t = now_ms();
+    load_fgets(path);
+    printf("  fgets %9.1f ms", now_ms() - t);
+
+    size_t part = size < READ1_MAX ? size : READ1_MAX;
+    t = now_ms();
+    load_read1(path, part);
+    t = (now_ms() - t) * size / part;
+    printf("  read1 %s%9.1f ms\n", part < size ? "~" : "", t);
+    fflush(stdout);
+    unlink(path);
+}
+
+int main(int argc, char** argv) {
+    static const size_t sizes[] = {1, 100, 1024};
+    const char* dir = getenv("TMPDIR");
+    if (!dir || !*dir) dir = "/tmp";
+
+    printf("line index kernel in use: %s\n", line_index_kernel());
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) bench_size(dir, strtoul(argv[i], NULL, 10));
+    } else {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) bench_size(dir, sizes[i]);
+    }
+    return 0;
+}
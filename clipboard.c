@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "clipboard.h"
+
+// 소켓 호출 하나가 멈춰 있을 수 있는 시간 (데몬과 편집기 양쪽)
+#define CLIP_TIMEOUT_SEC 5
+// 데몬이 한 연결에 쓰는 전체 시간. 데몬은 한 번에 한 연결만 받으므로
+// 조금씩 흘려 보내는 편집기 하나가 다른 편집기들을 막지 않게 한다 (큰 내용도 이 안에 오간다)
+#define CLIP_DEADLINE_SEC 60
+#define CLIP_TAG_MAX 64
+#define CLIP_CHUNK (64 * 1024)
+
+enum { SHARE_NONE, SHARE_TMUX, SHARE_DAEMON };
+
+static doc_range* held = NULL;
+static int share = SHARE_NONE;
+static int osc52 = 0;                   // 터미널에도 OSC 52 로 보낸다
+static char tag[CLIP_TAG_MAX];          // 이 편집기가 공유 클립보드에 붙이는 이름 (tmux 버퍼 이름 겸용)
+static unsigned long generation = 0;    // 데몬에 내보낸 횟수. 데몬의 내용이 마지막으로 보낸 것인지 가린다
+static struct sockaddr_un sock_addr;
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= w;
+    }
+    return 0;
+}
+
+static int write_chunk(const char* data, size_t len, void* arg) {
+    return write_all(*(int*)arg, data, len);
+}
+
+// fd 에서 끝까지 읽으며 doc 의 off 뒤에 이어 넣는다. 넣은 바이트 수는 *len 에 쌓인다
+static int insert_stream(document* doc, int fd, size_t off, size_t* len) {
+    char* buf = malloc(CLIP_CHUNK);
+    if (!buf) return -1;
+    int r = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, CLIP_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) r = -1;
+            break;
+        }
+        if (doc_insert(doc, off + *len, buf, n) < 0) {
+            r = -1;
+            break;
+        }
+        *len += n;
+    }
+    free(buf);
+    return r;
+}
+
+// 한 줄(개행 전까지, 최대 n - 1 바이트)을 한 바이트씩 읽는다. 뒤따르는 내용을 더 읽지 않기 위함
+static int read_line(int fd, char* out, size_t n) {
+    size_t i = 0;
+    for (;;) {
+        ssize_t r = read(fd, out + i, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        if (out[i] == '\n') break;
+        if (++i == n) return -1;
+    }
+    out[i] = '\0';
+    return 0;
+}
+
+// ---- tmux ----
+
+// tmux 명령을 띄우고 표준 입력(to_child)이나 표준 출력 쪽 파이프를 *fd 로 돌려준다
+static pid_t tmux_spawn(char* const argv[], int to_child, int* fd) {
+    int p[2];
+    if (pipe(p) < 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(to_child ? p[0] : null, STDIN_FILENO);
+        dup2(to_child ? null : p[1], STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(p[0]);
+        close(p[1]);
+        execvp("tmux", argv);
+        _exit(127);
+    }
+    close(to_child ? p[0] : p[1]);
+    if (pid < 0) {
+        close(to_child ? p[1] : p[0]);
+        return -1;
+    }
+    *fd = to_child ? p[1] : p[0];
+    return pid;
+}
+
+static int tmux_wait(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// 범위를 tmux 버퍼 tag 에 흘려 넣는다. -w 는 tmux 가 바깥 터미널의 클립보드에도 넣게 한다 (3.2 부터)
+static int tmux_put(doc_range* r) {
+    char* outer[] = { "tmux", "load-buffer", "-w", "-b", tag, "-", NULL };
+    char* plain[] = { "tmux", "load-buffer", "-b", tag, "-", NULL };
+    char** tries[] = { outer, plain };
+    for (int i = 0; i < 2; i++) {
+        int fd;
+        pid_t pid = tmux_spawn(tries[i], 1, &fd);
+        if (pid < 0) return -1;
+        doc_range_foreach(r, write_chunk, &fd);
+        close(fd);
+        if (tmux_wait(pid) == 0) return 0;
+    }
+    return -1;
+}
+
+// tmux 의 최신 버퍼가 이 편집기 것이면 0, 아니면 그 내용을 off 에 넣는다. 버퍼가 없으면 0
+static int tmux_get(document* doc, size_t off, size_t* len, int* own) {
+    char name[CLIP_TAG_MAX + 1] = "";
+    char* list[] = { "tmux", "list-buffers", "-F", "#{buffer_name}", NULL };
+    int fd;
+    pid_t pid = tmux_spawn(list, 0, &fd);
+    if (pid < 0) return -1;
+    int r = read_line(fd, name, sizeof(name));
+    close(fd);      // 나머지 목록은 읽지 않는다
+    tmux_wait(pid);
+    if (r < 0 || strcmp(name, tag) == 0) {
+        *own = 1;
+        return 0;
+    }
+
+    char* save[] = { "tmux", "save-buffer", "-b", name, "-", NULL };
+    if ((pid = tmux_spawn(save, 0, &fd)) < 0) return -1;
+    r = insert_stream(doc, fd, off, len);
+    close(fd);
+    if (tmux_wait(pid) < 0) r = -1;
+    return r;
+}
+
+// ---- 클립보드 데몬 ----
+// 요청은 한 줄 머리로 시작한다.
+//   "S <이름>\n" 뒤에 내용, 보내는 쪽이 쓰기를 닫으면 끝. 끝까지 받은 뒤에만 바꿔 끼운다
+//   "G\n" 이면 "<이름>\n" 뒤에 내용을 보내고 닫는다 (비어 있으면 이름도 빈 줄)
+
+// 이후 fd 의 읽기/쓰기 한 번이 tv 를 넘으면 실패하게 한다
+static int set_timeout(int fd, struct timeval tv) {
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) return -1;
+    return setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// 데몬이 멈춰 있어도 편집기가 CLIP_TIMEOUT_SEC 넘게 묶이지 않는다
+static int daemon_connect(void) {
+    struct timeval tv = { CLIP_TIMEOUT_SEC, 0 };
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (set_timeout(fd, tv) < 0 || connect(fd, (struct sockaddr*)&sock_addr, sizeof(sock_addr)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;    // daemon_spawn 이 거절인지 본다
+        return -1;
+    }
+    return fd;
+}
+
+static int daemon_put(doc_range* r) {
+    int fd = daemon_connect();
+    if (fd < 0) return -1;
+    char head[CLIP_TAG_MAX + 32];
+    int n = snprintf(head, sizeof(head), "S %s-%lu\n", tag, ++generation);
+    int ret = write_all(fd, head, n);
+    if (ret == 0) ret = doc_range_foreach(r, write_chunk, &fd);
+    shutdown(fd, SHUT_WR);
+    // 데몬이 다 받고 닫을 때까지 기다린다. 바로 뒤의 붙여 넣기가 옛 내용을 보지 않게
+    char c;
+    while (read(fd, &c, 1) < 0 && errno == EINTR) {}
+    close(fd);
+    return ret;
+}
+
+static int daemon_get(document* doc, size_t off, size_t* len, int* own) {
+    int fd = daemon_connect();
+    if (fd < 0) return -1;
+    char name[CLIP_TAG_MAX + 32], mine[CLIP_TAG_MAX + 32];
+    snprintf(mine, sizeof(mine), "%s-%lu", tag, generation);
+    int r = write_all(fd, "G\n", 2);
+    if (r == 0) r = read_line(fd, name, sizeof(name));
+    if (r == 0 && (name[0] == '\0' || strcmp(name, mine) == 0)) *own = 1;
+    else if (r == 0) r = insert_stream(doc, fd, off, len);
+    close(fd);
+    return r;
+}
+
+// 연결의 마감 시각까지 남은 시간(최대 CLIP_TIMEOUT_SEC)을 다음 호출의 제한으로 건다. 이미 지났으면 -1
+static int arm_deadline(int fd, const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long left = (deadline->tv_sec - now.tv_sec) * 1000000LL + (deadline->tv_nsec - now.tv_nsec) / 1000;
+    if (left <= 0) return -1;
+    if (left > CLIP_TIMEOUT_SEC * 1000000LL) left = CLIP_TIMEOUT_SEC * 1000000LL;
+    struct timeval tv = { left / 1000000, left % 1000000 };
+    return set_timeout(fd, tv);
+}
+
+static ssize_t serve_read(int fd, char* buf, size_t n, const struct timespec* deadline) {
+    for (;;) {
+        if (arm_deadline(fd, deadline) < 0) return -1;
+        ssize_t r = read(fd, buf, n);
+        if (r >= 0 || errno != EINTR) return r;
+    }
+}
+
+static int serve_write(int fd, const char* data, size_t len, const struct timespec* deadline) {
+    while (len > 0) {
+        if (arm_deadline(fd, deadline) < 0) return -1;
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// 연결 하나를 CLIP_DEADLINE_SEC 안에 처리한다. 넘기면 받던 내용은 버리고 끊는다
+static void serve(int fd, char** data, size_t* size, char* owner) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += CLIP_DEADLINE_SEC;
+
+    // 머리 줄까지 읽는다. 같이 온 내용은 버퍼 앞에 남겨 둔다
+    size_t len = 0, cap = CLIP_CHUNK;
+    char* buf = malloc(cap);
+    char* nl = NULL;
+    while (buf && !(nl = memchr(buf, '\n', len)) && len < CLIP_TAG_MAX + 32) {
+        ssize_t n = serve_read(fd, buf + len, cap - len, &deadline);
+        if (n <= 0) break;
+        len += n;
+    }
+    if (!nl) goto out;
+    char head[CLIP_TAG_MAX + 32];
+    size_t head_len = nl - buf;
+    if (head_len >= sizeof(head)) goto out;
+    memcpy(head, buf, head_len);
+    head[head_len] = '\0';
+
+    if (head[0] == 'G') {
+        if (serve_write(fd, owner, strlen(owner), &deadline) == 0 && serve_write(fd, "\n", 1, &deadline) == 0)
+            serve_write(fd, *data, *size, &deadline);
+        goto out;
+    }
+    if (head[0] != 'S' || head[1] != ' ') goto out;
+
+    len -= head_len + 1;
+    memmove(buf, nl + 1, len);
+    for (;;) {
+        if (len == cap) {
+            char* p = cap < CLIP_DAEMON_MAX ? realloc(buf, cap * 2) : NULL;
+            if (!p) break;
+            buf = p;
+            cap *= 2;
+        }
+        ssize_t n = serve_read(fd, buf + len, cap - len, &deadline);
+        if (n < 0) break;
+        if (n == 0) {
+            // 끝까지 받았을 때만 바꿔 끼운다
+            free(*data);
+            *data = buf;
+            *size = len;
+            snprintf(owner, CLIP_TAG_MAX + 32, "%s", head + 2);
+            return;
+        }
+        len += n;
+    }
+out:
+    free(buf);
+}
+
+static void daemon_run(int listen_fd) {
+    char* data = NULL;
+    size_t size = 0;
+    char owner[CLIP_TAG_MAX + 32] = "";
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        serve(fd, &data, &size, owner);
+        close(fd);
+    }
+}
+
+// 소켓을 열어 두고 떨어져 나간 손자 프로세스에게 넘긴다.
+// 손자는 세션을 새로 만들어 편집기가 끝나도 남고, 다음 편집기들이 이 소켓에 붙는다
+// 소켓 옆의 .lock 파일을 잡고 하므로 동시에 뜬 편집기들이 서로의 소켓을 지우지 않는다
+static int daemon_spawn(void) {
+    char lock_path[sizeof(sock_addr.sun_path) + 8];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", sock_addr.sun_path);
+    int lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock < 0) return -1;
+    while (flock(lock, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            close(lock);
+            return -1;
+        }
+    }
+
+    // 잠금을 기다리는 사이 다른 편집기가 띄웠으면 그것을 쓴다.
+    // 연결이 거절되거나 파일이 없을 때만 주인 없는 소켓으로 보고 지운다
+    int fd = daemon_connect();
+    if (fd >= 0 || (errno != ECONNREFUSED && errno != ENOENT)) {
+        if (fd >= 0) close(fd);
+        close(lock);
+        return fd >= 0 ? 0 : -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || (unlink(sock_addr.sun_path) < 0 && errno != ENOENT) ||
+        bind(fd, (struct sockaddr*)&sock_addr, sizeof(sock_addr)) < 0 || listen(fd, 16) < 0) {
+        if (fd >= 0) close(fd);
+        close(lock);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(lock);    // 데몬이 잠금을 물고 있지 않도록
+        setsid();
+        if (fork() != 0) _exit(0);
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGHUP, SIG_IGN);
+        if (chdir("/") < 0) { /* 작업 디렉터리는 쓰지 않는다 */ }
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        daemon_run(fd);
+        _exit(0);
+    }
+    close(fd);
+    if (pid >= 0) while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+    close(lock);    // 소켓이 이미 listen 중이므로 뒤에 오는 편집기는 바로 붙는다
+    return pid < 0 ? -1 : 0;
+}
+
+// $XDG_RUNTIME_DIR 나 /tmp/ceditor-<uid> 아래. 다른 사용자가 만들었거나 열려 있는 디렉터리는 쓰지 않는다
+static int socket_path(void) {
+    const char* run = getenv("XDG_RUNTIME_DIR");
+    char dir[sizeof(sock_addr.sun_path)];
+    if (run && run[0]) {
+        snprintf(dir, sizeof(dir), "%s", run);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/ceditor-%u", (unsigned)getuid());
+        mkdir(dir, 0700);
+    }
+    struct stat st;
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077))
+        return -1;
+    sock_addr.sun_family = AF_UNIX;
+    if (snprintf(sock_addr.sun_path, sizeof(sock_addr.sun_path), "%s/ceditor-clipboard", dir) >=
+        (int)sizeof(sock_addr.sun_path))
+        return -1;
+    return 0;
+}
+
+// ---- OSC 52 ----
+
+// 터미널에 "ESC ] 52 ; c ; <base64> BEL" 을 흘려 보낸다. 세 바이트씩 끊어 인코딩하므로
+// 조각 경계에 걸린 나머지 바이트는 다음 조각으로 넘긴다
+struct b64_stream {
+    int fd;
+    unsigned char rest[3];
+    int nrest;
+    char out[4096];
+    size_t nout;
+};
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int b64_group(struct b64_stream* s, const unsigned char* in, int n) {
+    unsigned v = in[0] << 16 | (n > 1 ? in[1] << 8 : 0) | (n > 2 ? in[2] : 0);
+    s->out[s->nout++] = b64[v >> 18 & 63];
+    s->out[s->nout++] = b64[v >> 12 & 63];
+    s->out[s->nout++] = n > 1 ? b64[v >> 6 & 63] : '=';
+    s->out[s->nout++] = n > 2 ? b64[v & 63] : '=';
+    if (s->nout + 4 > sizeof(s->out)) {
+        if (write_all(s->fd, s->out, s->nout) < 0) return -1;
+        s->nout = 0;
+    }
+    return 0;
+}
+
+static int b64_chunk(const char* data, size_t len, void* arg) {
+    struct b64_stream* s = arg;
+    const unsigned char* p = (const unsigned char*)data;
+    while (len > 0 && s->nrest > 0 && s->nrest < 3) {
+        s->rest[s->nrest++] = *p++;
+        len--;
+    }
+    if (s->nrest == 3) {
+        if (b64_group(s, s->rest, 3) < 0) return -1;
+        s->nrest = 0;
+    }
+    for (; len >= 3; p += 3, len -= 3)
+        if (b64_group(s, p, 3) < 0) return -1;
+    while (len-- > 0) s->rest[s->nrest++] = *p++;
+    return 0;
+}
+
+static int osc52_put(doc_range* r) {
+    struct b64_stream s = { .fd = STDOUT_FILENO };
+    if (write_all(s.fd, "\033]52;c;", 7) < 0) return -1;
+    if (doc_range_foreach(r, b64_chunk, &s) < 0) return -1;
+    if (s.nrest > 0 && b64_group(&s, s.rest, s.nrest) < 0) return -1;
+    if (write_all(s.fd, s.out, s.nout) < 0) return -1;
+    return write_all(s.fd, "\a", 1);
+}
+
+// ---- 공개 API ----
+
+void clipboard_init(void) {
+    const char* tmux = getenv("TMUX");
+    const char* term = getenv("TERM");
+    if (tmux && tmux[0]) {
+        // tmux 버퍼는 편집기 하나당 하나. 다시 내보내면 같은 버퍼가 갈리며 맨 앞으로 온다
+        snprintf(tag, sizeof(tag), "ceditor-%d", (int)getpid());
+        share = SHARE_TMUX;
+        return;
+    }
+    snprintf(tag, sizeof(tag), "%d", (int)getpid());
+    // 리눅스 콘솔은 OSC 52 를 모르므로 글자로 찍힐 수 있다
+    osc52 = isatty(STDOUT_FILENO) && term && strcmp(term, "dumb") != 0 && strcmp(term, "linux") != 0;
+    if (socket_path() < 0) return;
+    int fd = daemon_connect();
+    if (fd < 0 && daemon_spawn() == 0) fd = daemon_connect();
+    if (fd < 0) return;
+    close(fd);
+    share = SHARE_DAEMON;
+}
+
+int clipboard_copy(document* doc, size_t off, size_t len) {
+    doc_range* r = doc_copy_range(doc, off, len);
+    if (!r) return -1;
+    doc_range_free(held);
+    held = r;
+    return 0;
+}
+
+// 범위는 문서의 고치지 않는 블록만 가리키므로 문서 잠금 없이 읽어 내보낸다
+int clipboard_publish(void) {
+    if (!held) return 0;
+    int shared = 0;
+    if (share == SHARE_TMUX) shared = tmux_put(held) == 0;
+    else if (share == SHARE_DAEMON) shared = daemon_put(held) == 0;
+    if (osc52 && doc_range_length(held) <= CLIP_OSC52_MAX && osc52_put(held) == 0) shared = 1;
+    return shared;
+}
+
+// 받은 내용은 따로 만든 문서에 흘려 넣고 그 문서를 가리키는 범위만 남긴다
+int clipboard_fetch(void) {
+    if (share == SHARE_NONE) return 0;
+    document* got = doc_new();
+    if (!got) return -1;
+    size_t len = 0;
+    int own = 0;
+    int r = share == SHARE_TMUX ? tmux_get(got, 0, &len, &own) : daemon_get(got, 0, &len, &own);
+    if (r == 0 && !own) {
+        doc_range* range = doc_copy_range(got, 0, len);
+        if (range) {
+            doc_range_free(held);
+            held = range;
+        } else {
+            r = -1;
+        }
+    }
+    doc_free(got);
+    return r;
+}
+
+int clipboard_paste(document* doc, size_t off, size_t* len) {
+    *len = 0;
+    if (!held) return 0;
+    if (doc_insert_range(doc, off, held) < 0) return -1;
+    *len = doc_range_length(held);
+    return 0;
+}
+
+void clipboard_clear(void) {
+    doc_range_free(held);
+    held = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+#include <stddef.h>
+
+#include "document.h"
+
+// 클립보드
+// 복사한 내용을 문서 블록을 가리키는 범위(doc_range)로 들고 있어서, 몇 줄을 복사하든
+// 복사와 붙여 넣기는 조각 몇 개를 옮기는 것으로 끝난다. 원래 문서를 닫아도 내용은 남는다.
+// 복사한 내용은 시스템 클립보드에도 내보낸다. tmux 안이면 tmux 버퍼(load-buffer -w 로 바깥 터미널까지),
+// 아니면 같은 사용자의 편집기들이 함께 쓰는 클립보드 데몬(유닉스 소켓)과 터미널(OSC 52)로 보낸다.
+// 내보낼 때는 조각을 차례로 흘려 보내므로 큰 범위도 한 문자열로 모으지 않는다.
+// 붙여 넣기 전에 공유 클립보드의 최신 내용을 보고, 다른 곳에서 온 것이면 받아서 들고 있는 범위를 바꾼다.
+// 공유 클립보드와 주고받는 일(publish/fetch)은 문서 잠금 밖에서, 문서를 건드리는 copy/paste 는 잠금 안에서 부른다
+// (클립보드 자체는 UI 스레드에서만 쓴다)
+
+#define CLIP_OSC52_MAX (1024 * 1024)        // 이보다 큰 범위는 터미널로 보내지 않는다 (터미널들이 버린다)
+#define CLIP_DAEMON_MAX (1024L * 1024 * 1024)   // 데몬이 들고 있는 내용의 최대 크기
+
+// 공유 클립보드를 고른다. tmux 밖이면 데몬에 붙어 보고 없으면 띄운다.
+// 데몬은 fork 로 띄우므로 스레드를 만들기 전에 부를 것
+void clipboard_init(void);
+
+// doc[off, off + len) 을 복사해 둔다. 이전 내용은 버린다. 실패 시 -1 (문서 잠금 안에서)
+int clipboard_copy(document* doc, size_t off, size_t len);
+// 들고 있는 내용을 공유 클립보드에 내보낸다. 내보냈으면 1, 이 편집기 안에만 있으면 0 (잠금 밖에서)
+int clipboard_publish(void);
+// 공유 클립보드의 최신 내용이 다른 곳에서 온 것이면 받아 와서 들고 있는 내용으로 삼는다.
+// 닿지 못했거나 받다가 끊기면 -1 이고 들고 있던 내용을 그대로 둔다 (잠금 밖에서)
+int clipboard_fetch(void);
+// 들고 있는 내용을 doc 의 off 에 끼워 넣고 넣은 바이트 수를 *len 에 담는다 (비어 있으면 0). 실패 시 -1 (잠금 안에서)
+int clipboard_paste(document* doc, size_t off, size_t* len);
+void clipboard_clear(void);
+
+#endif
@@ -0,0 +1,1163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#include "document.h"
+#include "lineindex.h"
+
+// 추가 버퍼 블록 하나의 크기. 블록은 한 번 만들면 옮기지 않는다.
+#define ADD_BLOCK_SIZE (64 * 1024)
+// 매핑한 원본 파일은 이 크기 단위로 블록을 나눈다 (블록 안 오프셋은 32비트)
+#define ORIG_BLOCK_MAX ((size_t)1 << 30)
+// 개행 색인 페이지 하나의 항목 수
+#define NL_PAGE 4096
+// 개행 색인을 한 번에 만드는 양. 뷰포트 조회와 백그라운드 색인 모두 이 단위로 진행
+#define INDEX_STEP (256 * 1024)
+
+struct text_block {
+    char* data;
+    atomic_size_t len;          // 스냅숏을 읽는 스레드가 있어도 추가 블록 뒤쪽에만 덧붙인다
+    size_t cap;
+    int mapped;                 // 파일 매핑 영역을 가리킴 (data 를 해제하지 않음)
+
+    // '\n' 위치 색인 (오름차순). 페이지 단위로 늘어나 기존 항목이 움직이지 않으므로
+    // 공개된 nl_count 아래 항목은 잠금 없이 읽을 수 있다. [0, scanned) 바이트까지 색인됨
+    uint32_t** nl_pages;
+    size_t nl_npages;
+    atomic_size_t nl_count;
+    atomic_size_t scanned;
+    pthread_mutex_t idx_lock;
+    int idx_failed;
+    atomic_int crlf;            // 색인하면서 "\r\n" 을 본 적 있음
+};
+
+struct piece {
+    struct text_block* blk;
+    size_t start, len;
+};
+
+// 조각 배열. 스냅숏과 공유하다가 공유 중에 편집하면 그때 한 번 복사한다 (copy-on-write)
+struct piece_buf {
+    atomic_int refs;
+    struct piece items[];
+};
+
+// 블록과 원본 파일 매핑. 문서와 그 스냅숏들이 함께 쓰고 마지막 참조가 놓일 때 해제한다.
+// 블록은 만든 뒤 옮기지 않고 이미 쓴 바이트는 바뀌지 않으므로 스냅숏은 잠금 없이 읽는다
+struct doc_store {
+    atomic_int refs;
+    struct text_block** blocks;
+    size_t nblocks, blocks_cap;
+
+    // 원본 파일 매핑과 그 위의 블록들
+    void* map;
+    size_t map_len;
+    int map_heap;               // mmap 대신 읽어 들인 버퍼
+    struct text_block** orig;
+    size_t norig;
+    pthread_t indexer;
+    int indexer_running;
+    atomic_int stop;
+};
+
+// 커서가 있는 줄을 담는 갭 버퍼. 줄 안에서의 삽입/삭제는 여기서 끝나고
+// 다른 줄을 편집하거나 개행이 들어올 때 한 번에 피스 테이블로 반영된다.
+// 내용 = buf[0, gap_start) + buf[gap_end, cap), 개행은 들어가지 않는다.
+struct gap_line {
+    long line;              // 편집 중인 줄 (-1 이면 없음)
+    size_t start;           // 줄 시작 오프셋
+    size_t orig_len;        // 피스 테이블에 들어 있는 원래 길이
+    char* buf;
+    size_t cap, gap_start, gap_end;
+    int dirty;
+};
+
+struct document {
+    struct doc_store* store;
+    struct text_block* add;     // 현재 이어 쓰는 추가 버퍼 블록
+
+    struct piece_buf* pbuf;
+    struct piece* pieces;       // == pbuf->items
+    size_t npieces, pieces_cap;
+
+    // off_prefix[i], lf_prefix[i] : 조각 i 앞까지의 누적 바이트 수 / 개행 수
+    // 편집된 조각 이후로는 무효화되고 필요할 때 다시 채운다. [0, valid] 만 유효
+    // 개행 수는 원본 색인이 있어야 셀 수 있으므로 바이트 쪽과 따로 채운다
+    size_t* off_prefix;
+    long* lf_prefix;
+    size_t valid, lf_valid;
+
+    size_t length;          // 피스 테이블 기준 길이 (갭 버퍼 반영 전)
+    int crlf;               // 줄 끝이 "\r\n" 인 문서. '\r' 은 줄 길이에 넣지 않는다
+    long lf_edits;          // 편집으로 늘고 준 개행 수. 원본 개행 수는 색인이 끝나야 안다
+
+    struct gap_line gap;
+
+    int frozen;                 // 스냅숏 (읽기 전용)
+    unsigned long version;      // 편집할 때마다 1씩 증가
+    doc_edit_fn on_edit;        // 편집 알림 (스왑 저널 등)
+    void* on_edit_arg;
+};
+
+static struct text_block* block_alloc(document* doc, char* data, size_t cap, int mapped) {
+    struct doc_store* st = doc->store;
+    if (st->nblocks == st->blocks_cap) {
+        size_t n = st->blocks_cap ? st->blocks_cap * 2 : 8;
+        struct text_block** p = realloc(st->blocks, n * sizeof(*p));
+        if (!p) return NULL;
+        st->blocks = p;
+        st->blocks_cap = n;
+    }
+    struct text_block* blk = calloc(1, sizeof(*blk));
+    if (!blk) return NULL;
+    // 개행은 많아야 바이트 수만큼이므로 페이지 표는 처음에 다 잡아 둔다
+    blk->nl_npages = cap / NL_PAGE + 1;
+    blk->nl_pages = calloc(blk->nl_npages, sizeof(*blk->nl_pages));
+    if (!blk->nl_pages) {
+        free(blk);
+        return NULL;
+    }
+    blk->data = data;
+    blk->cap = cap;
+    blk->mapped = mapped;
+    pthread_mutex_init(&blk->idx_lock, NULL);
+    st->blocks[st->nblocks++] = blk;
+    return blk;
+}
+
+static struct text_block* block_new(document* doc, size_t cap) {
+    char* data = malloc(cap ? cap : 1);
+    if (!data) return NULL;
+    struct text_block* blk = block_alloc(doc, data, cap, 0);
+    if (!blk) free(data);
+    return blk;
+}
+
+static void block_free(struct text_block* blk) {
+    if (!blk->mapped) free(blk->data);
+    for (size_t i = 0; i < blk->nl_npages; i++) free(blk->nl_pages[i]);
+    free(blk->nl_pages);
+    pthread_mutex_destroy(&blk->idx_lock);
+    free(blk);
+}
+
+static uint32_t nl_at(const struct text_block* blk, size_t i) {
+    return blk->nl_pages[i / NL_PAGE][i % NL_PAGE];
+}
+
+// blk->data[scanned, to) 의 개행을 색인에 추가하고 공개한다.
+// 한 블록에 쓰는 쪽은 항상 하나 (추가 블록은 UI 스레드, 원본 블록은 idx_lock 보유자)
+static int block_scan(struct text_block* blk, size_t to) {
+    size_t from = atomic_load_explicit(&blk->scanned, memory_order_relaxed);
+    size_t count = atomic_load_explicit(&blk->nl_count, memory_order_relaxed);
+    int crlf = 0, ret = 0;
+
+    // 커널이 페이지 하나를 채울 때마다 다음 페이지를 붙여 준다
+    while (from < to) {
+        uint32_t** page = &blk->nl_pages[count / NL_PAGE];
+        if (!*page && !(*page = malloc(NL_PAGE * sizeof(uint32_t)))) {
+            blk->idx_failed = 1;
+            ret = -1;
+            break;
+        }
+        size_t slot = count % NL_PAGE;
+        count += line_index_scan(blk->data, from, to, *page + slot, NL_PAGE - slot, &from, &crlf);
+    }
+    if (crlf) atomic_store(&blk->crlf, 1);
+    atomic_store_explicit(&blk->nl_count, count, memory_order_release);
+    atomic_store_explicit(&blk->scanned, from, memory_order_release);
+    return ret;
+}
+
+static int block_ready(struct text_block* blk, size_t pos, size_t count) {
+    return atomic_load_explicit(&blk->scanned, memory_order_acquire) >= pos ||
+           atomic_load_explicit(&blk->nl_count, memory_order_acquire) >= count;
+}
+
+// 색인이 pos 바이트까지 되었거나 개행이 count 개 이상 찾아질 때까지 색인을 늘린다
+static void block_ensure(struct text_block* blk, size_t pos, size_t count) {
+    if (block_ready(blk, pos, count)) return;
+    pthread_mutex_lock(&blk->idx_lock);
+    if (pos > blk->len) pos = blk->len;
+    while (!block_ready(blk, pos, count) && !blk->idx_failed) {
+        size_t to = atomic_load_explicit(&blk->scanned, memory_order_relaxed) + INDEX_STEP;
+        if (to > blk->len) to = blk->len;
+        block_scan(blk, to);
+    }
+    pthread_mutex_unlock(&blk->idx_lock);
+}
+
+// pos 보다 앞에 있는 개행 수
+static size_t block_rank(struct text_block* blk, size_t pos) {
+    block_ensure(blk, pos, SIZE_MAX);
+    size_t lo = 0, hi = atomic_load_explicit(&blk->nl_count, memory_order_acquire);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (nl_at(blk, mid) < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// [from, to) 안에서 k 번째(1부터) 개행의 위치. 없으면 0 을 돌려준다
+static int block_find_nl(struct text_block* blk, size_t from, size_t to, size_t k, size_t* pos) {
+    size_t idx = block_rank(blk, from) + k - 1;
+    block_ensure(blk, to, idx + 1);
+    if (idx >= atomic_load_explicit(&blk->nl_count, memory_order_acquire)) return 0;
+    size_t at = nl_at(blk, idx);
+    if (at >= to) return 0;
+    *pos = at;
+    return 1;
+}
+
+static long piece_lf(const struct piece* p) {
+    return (long)(block_rank(p->blk, p->start + p->len) - block_rank(p->blk, p->start));
+}
+
+// 원본 블록의 나머지 색인을 뒤에서 조금씩 만든다
+static void* index_worker(void* arg) {
+    struct doc_store* st = arg;
+    for (size_t i = 0; i < st->norig; i++) {
+        struct text_block* blk = st->orig[i];
+        while (!atomic_load(&st->stop)) {
+            pthread_mutex_lock(&blk->idx_lock);
+            size_t from = atomic_load_explicit(&blk->scanned, memory_order_relaxed);
+            size_t to = from + INDEX_STEP;
+            if (to > blk->len) to = blk->len;
+            if (from < to && !blk->idx_failed) block_scan(blk, to);
+            pthread_mutex_unlock(&blk->idx_lock);
+            if (to >= blk->len || blk->idx_failed) break;
+            sched_yield();      // 화면 쪽 조회가 잠금을 먼저 잡을 수 있게 양보
+        }
+    }
+    return NULL;
+}
+
+static void store_release(struct doc_store* st) {
+    if (!st || atomic_fetch_sub(&st->refs, 1) != 1) return;
+    if (st->indexer_running) {
+        atomic_store(&st->stop, 1);
+        pthread_join(st->indexer, NULL);
+    }
+    for (size_t i = 0; i < st->nblocks; i++) block_free(st->blocks[i]);
+    free(st->blocks);
+    free(st->orig);
+    if (st->map_heap) free(st->map);
+    else if (st->map) munmap(st->map, st->map_len);
+    free(st);
+}
+
+static void pieces_release(struct piece_buf* b) {
+    if (b && atomic_fetch_sub(&b->refs, 1) == 1) free(b);
+}
+
+// 조각 배열을 n 개까지 쓸 수 있게 한다. 조각을 바꾸는 곳은 모두 먼저 이것을 부르므로
+// 스냅숏과 공유 중인 배열은 여기서 복사해 떼어 낸다
+static int reserve_pieces(document* doc, size_t n) {
+    int shared = doc->pbuf && atomic_load(&doc->pbuf->refs) > 1;
+    if (n <= doc->pieces_cap && !shared) return 0;
+    size_t cap = doc->pieces_cap ? doc->pieces_cap : 16;
+    while (cap < n) cap *= 2;
+
+    struct piece_buf* b;
+    if (shared) {
+        b = malloc(sizeof(*b) + cap * sizeof(struct piece));
+        if (!b) return -1;
+        atomic_init(&b->refs, 1);
+        memcpy(b->items, doc->pieces, doc->npieces * sizeof(struct piece));
+        pieces_release(doc->pbuf);
+    } else {
+        b = realloc(doc->pbuf, sizeof(*b) + cap * sizeof(struct piece));
+        if (!b) return -1;
+        if (!doc->pbuf) atomic_init(&b->refs, 1);
+    }
+    doc->pbuf = b;
+    doc->pieces = b->items;
+    if (cap == doc->pieces_cap) return 0;
+
+    size_t* o = realloc(doc->off_prefix, (cap + 1) * sizeof(*o));
+    if (!o) return -1;
+    doc->off_prefix = o;
+    long* l = realloc(doc->lf_prefix, (cap + 1) * sizeof(*l));
+    if (!l) return -1;
+    doc->lf_prefix = l;
+    doc->pieces_cap = cap;
+    return 0;
+}
+
+static void extend_prefix(document* doc, size_t upto) {
+    while (doc->valid < upto) {
+        size_t i = doc->valid;
+        doc->off_prefix[i + 1] = doc->off_prefix[i] + doc->pieces[i].len;
+        doc->valid++;
+    }
+}
+
+static void extend_lf_prefix(document* doc, size_t upto) {
+    extend_prefix(doc, upto);
+    while (doc->lf_valid < upto) {
+        size_t i = doc->lf_valid;
+        doc->lf_prefix[i + 1] = doc->lf_prefix[i] + piece_lf(&doc->pieces[i]);
+        doc->lf_valid++;
+    }
+}
+
+static void invalidate_from(document* doc, size_t i) {
+    if (doc->valid > i) doc->valid = i;
+    if (doc->lf_valid > i) doc->lf_valid = i;
+}
+
+// off 를 포함하는 조각 번호. off == 문서 길이면 npieces
+static size_t find_piece(document* doc, size_t off) {
+    if (off >= doc->length) return doc->npieces;
+    while (doc->valid < doc->npieces && doc->off_prefix[doc->valid] <= off)
+        extend_prefix(doc, doc->valid + 1);
+
+    size_t lo = 0, hi = doc->valid - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (doc->off_prefix[mid] <= off) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// 원본 텍스트(파일 매핑 또는 통째로 읽은 버퍼)를 블록으로 나누어 조각으로 건다
+static int attach_original(document* doc, char* data, size_t size) {
+    struct doc_store* st = doc->store;
+    size_t n = (size + ORIG_BLOCK_MAX - 1) / ORIG_BLOCK_MAX;
+    st->orig = calloc(n, sizeof(*st->orig));
+    if (!st->orig || reserve_pieces(doc, n) < 0) return -1;
+
+    for (size_t off = 0; off < size; off += ORIG_BLOCK_MAX) {
+        size_t len = size - off < ORIG_BLOCK_MAX ? size - off : ORIG_BLOCK_MAX;
+        struct text_block* blk = block_alloc(doc, data + off, len, 1);
+        if (!blk) return -1;
+        blk->len = len;
+        st->orig[st->norig++] = blk;
+        doc->pieces[doc->npieces].blk = blk;
+        doc->pieces[doc->npieces].start = 0;
+        doc->pieces[doc->npieces].len = len;
+        doc->npieces++;
+    }
+    doc->length = size;
+    return 0;
+}
+
+// mmap 할 수 없는 파일(파이프 등)은 통째로 읽는다
+static char* read_all(int fd, size_t* size) {
+    size_t len = 0, cap = 64 * 1024;
+    char* buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = read(fd, buf + len, cap - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            return NULL;
+        }
+        len += n;
+        if (len == cap) {
+            char* p = realloc(buf, cap * 2);
+            if (!p) free(buf);
+            buf = p;
+            cap *= 2;
+        }
+    }
+    *size = len;
+    return buf;
+}
+
+document* doc_new(void) {
+    document* doc = calloc(1, sizeof(*doc));
+    if (!doc) return NULL;
+    doc->store = calloc(1, sizeof(*doc->store));
+    if (doc->store) atomic_init(&doc->store->refs, 1);
+    if (!doc->store || reserve_pieces(doc, 16) < 0) {
+        doc_free(doc);
+        return NULL;
+    }
+    doc->off_prefix[0] = 0;
+    doc->lf_prefix[0] = 0;
+    doc->gap.line = -1;
+    return doc;
+}
+
+// 파일을 mmap 으로 열고 개행 색인은 필요한 만큼만 만든다.
+// 편집하지 않은 부분은 매핑을 그대로 가리키므로 힙으로 복사되지 않는다.
+document* doc_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat sb;
+    document* doc = NULL;
+    if (fstat(fd, &sb) < 0) goto fail;
+    doc = doc_new();
+    if (!doc) goto fail;
+    struct doc_store* st = doc->store;
+
+    if (S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        void* map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            st->map = map;
+            st->map_len = sb.st_size;
+        }
+    }
+    if (!st->map) {
+        size_t size;
+        char* data = read_all(fd, &size);
+        if (!data) goto fail;
+        st->map = data;
+        st->map_len = size;
+        st->map_heap = 1;
+    }
+    if (attach_original(doc, st->map, st->map_len) < 0) goto fail;
+    close(fd);
+
+    // 앞부분을 한 번 색인해 보고 줄 끝 형식을 정한다
+    if (st->norig > 0) {
+        block_ensure(st->orig[0], st->orig[0]->len, 1);
+        doc->crlf = atomic_load(&st->orig[0]->crlf);
+    }
+
+    // 첫 화면은 조회할 때 필요한 만큼만 색인하고, 나머지는 뒤에서 만든다
+    if (st->map_len > INDEX_STEP && pthread_create(&st->indexer, NULL, index_worker, st) == 0)
+        st->indexer_running = 1;
+    return doc;
+
+fail:
+    close(fd);
+    doc_free(doc);
+    return NULL;
+}
+
+void doc_free(document* doc) {
+    if (!doc) return;
+    store_release(doc->store);
+    pieces_release(doc->pbuf);
+    free(doc->off_prefix);
+    free(doc->lf_prefix);
+    free(doc->gap.buf);
+    free(doc);
+}
+
+static size_t piece_read(document* doc, size_t off, char* out, size_t len);
+
+// line 번째 줄의 시작 오프셋. 줄이 없으면 0 을 돌려준다.
+// 찾는 줄이 다음 조각 안에 있으면 그 조각의 개행을 끝까지 세지 않는다 (지연 색인)
+static int piece_find_line(document* doc, long line, size_t* off) {
+    if (line <= 0) {
+        *off = 0;
+        return line == 0;
+    }
+    while (doc->lf_prefix[doc->lf_valid] < line) {
+        if (doc->lf_valid == doc->npieces) return 0;
+        size_t i = doc->lf_valid;
+        extend_prefix(doc, i + 1);
+        const struct piece* p = &doc->pieces[i];
+        size_t pos;
+        if (block_find_nl(p->blk, p->start, p->start + p->len, line - doc->lf_prefix[i], &pos)) {
+            *off = doc->off_prefix[i] + (pos - p->start) + 1;
+            return 1;
+        }
+        extend_lf_prefix(doc, i + 1);
+    }
+
+    // line 번째 개행을 포함하는 가장 앞 조각
+    size_t lo = 0, hi = doc->lf_valid - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (doc->lf_prefix[mid + 1] >= line) hi = mid;
+        else lo = mid + 1;
+    }
+
+    const struct piece* p = &doc->pieces[lo];
+    size_t pos = p->start;
+    block_find_nl(p->blk, p->start, p->start + p->len, line - doc->lf_prefix[lo], &pos);
+    *off = doc->off_prefix[lo] + (pos - p->start) + 1;
+    return 1;
+}
+
+static size_t piece_line_offset(document* doc, long line) {
+    size_t off;
+    return piece_find_line(doc, line, &off) ? off : doc->length;
+}
+
+static size_t piece_line_length(document* doc, long line) {
+    size_t start, end;
+    if (!piece_find_line(doc, line, &start)) return 0;
+    if (!piece_find_line(doc, line + 1, &end)) return doc->length - start;
+
+    size_t len = end - 1 - start;
+    char c;
+    if (doc->crlf && len > 0 && piece_read(doc, start + len - 1, &c, 1) == 1 && c == '\r')
+        len--;
+    return len;
+}
+
+static size_t piece_read(document* doc, size_t off, char* out, size_t len) {
+    if (off >= doc->length) return 0;
+    if (len > doc->length - off) len = doc->length - off;
+
+    size_t done = 0;
+    size_t i = find_piece(doc, off);
+    size_t rel = off - doc->off_prefix[i];
+    while (done < len && i < doc->npieces) {
+        const struct piece* p = &doc->pieces[i];
+        size_t n = p->len - rel;
+        if (n > len - done) n = len - done;
+        memcpy(out + done, p->blk->data + p->start + rel, n);
+        done += n;
+        rel = 0;
+        i++;
+    }
+    return done;
+}
+
+static int piece_insert(document* doc, size_t off, const char* text, size_t len) {
+    if (len == 0) return 0;
+    if (off > doc->length) off = doc->length;
+    if (reserve_pieces(doc, doc->npieces + 2) < 0) return -1;
+
+    // 추가 버퍼에 기록. 블록에 자리가 없으면 새 블록, 큰 삽입은 전용 블록
+    struct text_block* blk = doc->add;
+    if (!blk || blk->cap - blk->len < len) {
+        blk = block_new(doc, len > ADD_BLOCK_SIZE ? len : ADD_BLOCK_SIZE);
+        if (!blk) return -1;
+        if (len <= ADD_BLOCK_SIZE) doc->add = blk;
+    }
+    size_t start = blk->len;
+    size_t nl_before = atomic_load_explicit(&blk->nl_count, memory_order_relaxed);
+    memcpy(blk->data + start, text, len);
+    blk->len += len;
+    if (block_scan(blk, blk->len) < 0) return -1;
+
+    struct piece np = { blk, start, len };
+    size_t i = find_piece(doc, off);
+    size_t rel = (i < doc->npieces) ? off - doc->off_prefix[i] : 0;
+
+    if (rel == 0 && i > 0 && doc->pieces[i - 1].blk == blk &&
+        doc->pieces[i - 1].start + doc->pieces[i - 1].len == start) {
+        // 연속 타이핑: 직전 조각을 늘리기만 한다
+        doc->pieces[i - 1].len += len;
+        invalidate_from(doc, i - 1);
+    } else if (rel == 0) {
+        memmove(&doc->pieces[i + 1], &doc->pieces[i], (doc->npieces - i) * sizeof(struct piece));
+        doc->pieces[i] = np;
+        doc->npieces++;
+        invalidate_from(doc, i);
+    } else {
+        struct piece old = doc->pieces[i];
+        memmove(&doc->pieces[i + 3], &doc->pieces[i + 1], (doc->npieces - i - 1) * sizeof(struct piece));
+        doc->pieces[i].len = rel;
+        doc->pieces[i + 1] = np;
+        doc->pieces[i + 2].blk = old.blk;
+        doc->pieces[i + 2].start = old.start + rel;
+        doc->pieces[i + 2].len = old.len - rel;
+        doc->npieces += 2;
+        invalidate_from(doc, i);
+    }
+
+    doc->length += len;
+    doc->lf_edits += (long)(atomic_load_explicit(&blk->nl_count, memory_order_relaxed) - nl_before);
+    return 0;
+}
+
+static int piece_delete(document* doc, size_t off, size_t len) {
+    if (off >= doc->length || len == 0) return 0;
+    if (len > doc->length - off) len = doc->length - off;
+    if (reserve_pieces(doc, doc->npieces + 1) < 0) return -1;
+
+    size_t end = off + len;
+    size_t a = find_piece(doc, off);
+    size_t b = find_piece(doc, end - 1);
+
+    long lf = 0;
+    for (size_t k = a; k <= b; k++) {
+        const struct piece* p = &doc->pieces[k];
+        size_t ps = doc->off_prefix[k];
+        size_t s = (off > ps) ? off - ps : 0;
+        size_t e = (end < ps + p->len) ? end - ps : p->len;
+        lf += (long)(block_rank(p->blk, p->start + e) - block_rank(p->blk, p->start + s));
+    }
+
+    struct piece repl[2];
+    size_t n = 0;
+    size_t lrel = off - doc->off_prefix[a];
+    size_t rrel = end - doc->off_prefix[b];
+    if (lrel > 0) {
+        repl[n] = doc->pieces[a];
+        repl[n++].len = lrel;
+    }
+    if (rrel < doc->pieces[b].len) {
+        repl[n] = doc->pieces[b];
+        repl[n].start += rrel;
+        repl[n++].len -= rrel;
+    }
+
+    memmove(&doc->pieces[a + n], &doc->pieces[b + 1], (doc->npieces - b - 1) * sizeof(struct piece));
+    memcpy(&doc->pieces[a], repl, n * sizeof(struct piece));
+    doc->npieces = doc->npieces - (b - a + 1) + n;
+    invalidate_from(doc, a);
+
+    doc->length -= len;
+    doc->lf_edits -= lf;
+    return 0;
+}
+
+
+static int piece_foreach_range(document* doc, size_t from, size_t to, doc_chunk_fn fn, void* arg) {
+    if (from >= to) return 0;
+    size_t i = find_piece(doc, from);
+    size_t rel = from - doc->off_prefix[i];
+    size_t left = to - from;
+    for (; left > 0 && i < doc->npieces; i++, rel = 0) {
+        const struct piece* p = &doc->pieces[i];
+        size_t n = p->len - rel;
+        if (n > left) n = left;
+        int r = fn(p->blk->data + p->start + rel, n, arg);
+        if (r) return r;
+        left -= n;
+    }
+    return 0;
+}
+
+// ---- 갭 버퍼 ----
+
+static size_t gap_len(const struct gap_line* g) {
+    return g->cap - (g->gap_end - g->gap_start);
+}
+
+// 갭을 pos 로 옮긴다. 옮긴 거리만큼만 복사하므로 연속 입력은 O(1)
+static void gap_move(struct gap_line* g, size_t pos) {
+    if (pos < g->gap_start) {
+        size_t n = g->gap_start - pos;
+        memmove(g->buf + g->gap_end - n, g->buf + pos, n);
+        g->gap_start -= n;
+        g->gap_end -= n;
+    } else if (pos > g->gap_start) {
+        size_t n = pos - g->gap_start;
+        memmove(g->buf + g->gap_start, g->buf + g->gap_end, n);
+        g->gap_start += n;
+        g->gap_end += n;
+    }
+}
+
+static int gap_reserve(struct gap_line* g, size_t need) {
+    if (g->gap_end - g->gap_start >= need) return 0;
+    size_t len = gap_len(g);
+    size_t cap = g->cap ? g->cap * 2 : 128;
+    while (cap < len + need) cap *= 2;
+
+    char* p = realloc(g->buf, cap);
+    if (!p) return -1;
+    size_t tail = g->cap - g->gap_end;
+    memmove(p + cap - tail, p + g->gap_end, tail);
+    g->buf = p;
+    g->gap_end = cap - tail;
+    g->cap = cap;
+    return 0;
+}
+
+static void gap_copy(const struct gap_line* g, size_t rel, char* out, size_t n) {
+    if (rel < g->gap_start) {
+        size_t k = g->gap_start - rel;
+        if (k > n) k = n;
+        memcpy(out, g->buf + rel, k);
+        out += k;
+        rel += k;
+        n -= k;
+    }
+    memcpy(out, g->buf + g->gap_end + (rel - g->gap_start), n);
+}
+
+// 갭 버퍼의 내용을 피스 테이블에 반영하고 비운다
+static int gap_flush(document* doc) {
+    struct gap_line* g = &doc->gap;
+    if (g->line < 0) return 0;
+    if (g->dirty) {
+        size_t len = gap_len(g);
+        gap_move(g, len);
+        if (piece_delete(doc, g->start, g->orig_len) < 0) return -1;
+        if (piece_insert(doc, g->start, g->buf, len) < 0) return -1;
+    }
+    g->line = -1;
+    return 0;
+}
+
+// line 을 갭 버퍼로 가져온다
+static int gap_activate(document* doc, long line) {
+    struct gap_line* g = &doc->gap;
+    if (g->line == line) return 0;
+    if (gap_flush(doc) < 0) return -1;
+
+    size_t len = piece_line_length(doc, line);
+    g->gap_start = 0;                       // 기존 내용 버림
+    g->gap_end = g->cap;
+    if (gap_reserve(g, len + 64) < 0) return -1;
+    g->start = piece_line_offset(doc, line);
+    g->orig_len = len;
+    piece_read(doc, g->start, g->buf, len);
+    g->gap_start = len;
+    g->gap_end = g->cap;
+    g->line = line;
+    g->dirty = 0;
+    return 0;
+}
+
+// ---- 공개 API: 갭 버퍼가 반영된 문서 ----
+
+size_t doc_length(document* doc) {
+    const struct gap_line* g = &doc->gap;
+    if (g->line < 0) return doc->length;
+    return doc->length - g->orig_len + gap_len(g);
+}
+
+// 색인하지 않는다. 줄 끝 형식은 doc_open 이 첫 원본 블록을 색인하며 "\r\n" 을 봤는지로 정해 두고 바꾸지 않는다
+const char* doc_eol(document* doc) {
+    return doc->crlf ? "\r\n" : "\n";
+}
+
+long doc_line_count(document* doc) {
+    long n = doc->lf_edits + 1;
+    for (size_t i = 0; i < doc->store->norig; i++) {
+        struct text_block* blk = doc->store->orig[i];
+        block_ensure(blk, blk->len, SIZE_MAX);
+        n += (long)atomic_load_explicit(&blk->nl_count, memory_order_acquire);
+    }
+    return n;
+}
+
+int doc_line_exists(document* doc, long line) {
+    size_t off;
+    return piece_find_line(doc, line, &off);
+}
+
+long doc_line_at(document* doc, size_t off) {
+    const struct gap_line* g = &doc->gap;
+    if (g->line >= 0 && off >= g->start) {
+        // 갭 버퍼의 줄에는 개행이 없다
+        if (off <= g->start + gap_len(g)) return g->line;
+        off = off - gap_len(g) + g->orig_len;
+    }
+    if (off > doc->length) off = doc->length;
+    size_t i = find_piece(doc, off);
+    extend_lf_prefix(doc, i);
+    long line = doc->lf_prefix[i];
+    if (i < doc->npieces) {
+        const struct piece* p = &doc->pieces[i];
+        size_t rel = off - doc->off_prefix[i];
+        line += (long)(block_rank(p->blk, p->start + rel) - block_rank(p->blk, p->start));
+    }
+    return line;
+}
+
+size_t doc_line_offset(document* doc, long line) {
+    const struct gap_line* g = &doc->gap;
+    size_t off = piece_line_offset(doc, line);
+    if (g->line >= 0 && line > g->line) off = off - g->orig_len + gap_len(g);
+    return off;
+}
+
+size_t doc_line_length(document* doc, long line) {
+    if (line == doc->gap.line) return gap_len(&doc->gap);
+    return piece_line_length(doc, line);
+}
+
+size_t doc_read(document* doc, size_t off, char* out, size_t len) {
+    const struct gap_line* g = &doc->gap;
+    if (g->line < 0) return piece_read(doc, off, out, len);
+
+    size_t total = doc_length(doc);
+    if (off >= total) return 0;
+    if (len > total - off) len = total - off;
+
+    size_t glen = gap_len(g), done = 0;
+    if (off < g->start) {
+        size_t n = g->start - off;
+        if (n > len) n = len;
+        done = piece_read(doc, off, out, n);
+    }
+    size_t v = off + done;
+    if (done < len && v < g->start + glen) {
+        size_t rel = v - g->start;
+        size_t n = glen - rel;
+        if (n > len - done) n = len - done;
+        gap_copy(g, rel, out + done, n);
+        done += n;
+    }
+    if (done < len) {
+        v = off + done;
+        done += piece_read(doc, v - glen + g->orig_len, out + done, len - done);
+    }
+    return done;
+}
+
+size_t doc_get_line(document* doc, long line, char** buf, size_t* cap) {
+    size_t len = doc_line_length(doc, line);
+    if (*cap < len + 1) {
+        size_t n = *cap ? *cap : 256;
+        while (n < len + 1) n *= 2;
+        char* p = realloc(*buf, n);
+        if (!p) return 0;
+        *buf = p;
+        *cap = n;
+    }
+    if (line == doc->gap.line) gap_copy(&doc->gap, 0, *buf, len);
+    else doc_read(doc, doc_line_offset(doc, line), *buf, len);
+    (*buf)[len] = '\0';
+    return len;
+}
+
+// 성공한 편집을 기록하고 알린다. 삭제는 text 가 지워진 내용
+static void edited(document* doc, int op, size_t off, const char* text, size_t len) {
+    doc->version++;
+    if (doc->on_edit) doc->on_edit(op, off, text, len, doc->on_edit_arg);
+}
+
+int doc_insert(document* doc, size_t off, const char* text, size_t len) {
+    if (doc->frozen) return -1;
+    if (gap_flush(doc) < 0) return -1;
+    if (off > doc->length) off = doc->length;
+    if (piece_insert(doc, off, text, len) < 0) return -1;
+    if (len > 0) edited(doc, DOC_EDIT_INSERT, off, text, len);
+    return 0;
+}
+
+int doc_delete(document* doc, size_t off, size_t len) {
+    if (doc->frozen) return -1;
+    if (gap_flush(doc) < 0) return -1;
+    if (off >= doc->length) return 0;
+    if (len > doc->length - off) len = doc->length - off;
+    // 알림을 받는 쪽이 있으면 지울 내용을 먼저 읽어 둔다
+    char* text = NULL;
+    if (doc->on_edit && len > 0) {
+        if (!(text = malloc(len))) return -1;
+        piece_read(doc, off, text, len);
+    }
+    int r = piece_delete(doc, off, len);
+    if (r == 0 && len > 0) edited(doc, DOC_EDIT_DELETE, off, text, len);
+    free(text);
+    return r;
+}
+
+int doc_insert_at(document* doc, long line, size_t col, const char* text, size_t len) {
+    if (doc->frozen) return -1;
+    if (len == 0) return 0;
+    size_t line_len = doc_line_length(doc, line);
+    if (col > line_len) col = line_len;
+
+    // 개행이 없는 입력은 갭 버퍼에서 처리
+    if (!memchr(text, '\n', len) && doc_line_exists(doc, line) && gap_activate(doc, line) == 0) {
+        struct gap_line* g = &doc->gap;
+        if (gap_reserve(g, len) < 0) return -1;
+        gap_move(g, col);
+        memcpy(g->buf + g->gap_start, text, len);
+        g->gap_start += len;
+        g->dirty = 1;
+        edited(doc, DOC_EDIT_INSERT, g->start + col, text, len);
+        return 0;
+    }
+    return doc_insert(doc, doc_line_offset(doc, line) + col, text, len);
+}
+
+int doc_delete_at(document* doc, long line, size_t col, size_t len) {
+    if (doc->frozen) return -1;
+    if (len == 0) return 0;
+    size_t line_len = doc_line_length(doc, line);
+
+    // 줄 안에서 끝나는 삭제는 갭 버퍼에서 처리
+    if (col + len <= line_len && gap_activate(doc, line) == 0) {
+        struct gap_line* g = &doc->gap;
+        gap_move(g, col);
+        g->gap_end += len;
+        g->dirty = 1;
+        // 지운 바이트는 갭 안에 그대로 남아 있다
+        edited(doc, DOC_EDIT_DELETE, g->start + col, g->buf + g->gap_end - len, len);
+        return 0;
+    }
+    return doc_delete(doc, doc_line_offset(doc, line) + col, len);
+}
+
+int doc_foreach_chunk(document* doc, doc_chunk_fn fn, void* arg) {
+    const struct gap_line* g = &doc->gap;
+    if (g->line < 0) return piece_foreach_range(doc, 0, doc->length, fn, arg);
+
+    int r;
+    if ((r = piece_foreach_range(doc, 0, g->start, fn, arg))) return r;
+    if (g->gap_start > 0 && (r = fn(g->buf, g->gap_start, arg))) return r;
+    if (g->cap > g->gap_end && (r = fn(g->buf + g->gap_end, g->cap - g->gap_end, arg))) return r;
+    return piece_foreach_range(doc, g->start + g->orig_len, doc->length, fn, arg);
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// 지금 내용을 얼린 읽기 전용 문서. 블록 저장소와 조각 배열을 참조만 늘려 함께 쓰므로
+// 내용 크기와 무관하게 바로 만들어진다. 원래 문서가 이후에 편집되면 조각 배열만 그쪽에서 복사된다.
+document* doc_snapshot(document* doc) {
+    if (gap_flush(doc) < 0) return NULL;
+    document* snap = calloc(1, sizeof(*snap));
+    if (!snap) return NULL;
+    snap->off_prefix = malloc((doc->npieces + 1) * sizeof(*snap->off_prefix));
+    snap->lf_prefix = malloc((doc->npieces + 1) * sizeof(*snap->lf_prefix));
+    if (!snap->off_prefix || !snap->lf_prefix) {
+        free(snap->off_prefix);
+        free(snap->lf_prefix);
+        free(snap);
+        return NULL;
+    }
+    snap->off_prefix[0] = 0;
+    snap->lf_prefix[0] = 0;
+
+    atomic_fetch_add(&doc->store->refs, 1);
+    atomic_fetch_add(&doc->pbuf->refs, 1);
+    snap->store = doc->store;
+    snap->pbuf = doc->pbuf;
+    snap->pieces = doc->pieces;
+    snap->npieces = snap->pieces_cap = doc->npieces;
+    snap->length = doc->length;
+    snap->crlf = doc->crlf;
+    snap->lf_edits = doc->lf_edits;
+    snap->version = doc->version;
+    snap->gap.line = -1;
+    snap->frozen = 1;
+    return snap;
+}
+
+// 복사한 범위. 블록은 옮기지도 고치지도 않으므로 조각과 저장소 참조만 들고 있으면 된다
+struct doc_range {
+    struct doc_store* store;
+    size_t len, npieces;
+    struct piece pieces[];
+};
+
+doc_range* doc_copy_range(document* doc, size_t off, size_t len) {
+    if (gap_flush(doc) < 0) return NULL;
+    if (off > doc->length) off = doc->length;
+    if (len > doc->length - off) len = doc->length - off;
+
+    size_t a = find_piece(doc, off), n = 0;
+    if (len > 0) n = find_piece(doc, off + len - 1) - a + 1;
+    doc_range* r = malloc(sizeof(*r) + n * sizeof(struct piece));
+    if (!r) return NULL;
+    memcpy(r->pieces, doc->pieces + a, n * sizeof(struct piece));
+    if (n > 0) {
+        // 양 끝 조각은 범위에 든 부분만 남긴다
+        size_t lrel = off - doc->off_prefix[a];
+        r->pieces[0].start += lrel;
+        r->pieces[0].len -= lrel;
+        r->pieces[n - 1].len = off + len - (doc->off_prefix[a + n - 1] + (n == 1 ? lrel : 0));
+    }
+    atomic_fetch_add(&doc->store->refs, 1);
+    r->store = doc->store;
+    r->len = len;
+    r->npieces = n;
+    return r;
+}
+
+size_t doc_range_length(doc_range* r) {
+    return r ? r->len : 0;
+}
+
+int doc_range_foreach(doc_range* r, doc_chunk_fn fn, void* arg) {
+    for (size_t i = 0; i < r->npieces; i++) {
+        const struct piece* p = &r->pieces[i];
+        int ret = fn(p->blk->data + p->start, p->len, arg);
+        if (ret) return ret;
+    }
+    return 0;
+}
+
+void doc_range_free(doc_range* r) {
+    if (!r) return;
+    store_release(r->store);
+    free(r);
+}
+
+// 다른 문서에서 복사한 범위는 이 문서의 블록 하나로 옮겨 적는다 (조각 하나가 된다)
+static int range_import(document* doc, const doc_range* r, struct piece* out) {
+    struct text_block* blk = block_new(doc, r->len);
+    if (!blk) return -1;
+    size_t at = 0;
+    for (size_t i = 0; i < r->npieces; i++) {
+        memcpy(blk->data + at, r->pieces[i].blk->data + r->pieces[i].start, r->pieces[i].len);
+        at += r->pieces[i].len;
+    }
+    blk->len = at;
+    if (block_scan(blk, at) < 0) return -1;
+    out->blk = blk;
+    out->start = 0;
+    out->len = at;
+    return 0;
+}
+
+int doc_insert_range(document* doc, size_t off, doc_range* r) {
+    if (doc->frozen) return -1;
+    if (gap_flush(doc) < 0) return -1;
+    if (!r || r->len == 0) return 0;
+    if (off > doc->length) off = doc->length;
+
+    struct piece one;
+    const struct piece* src = r->pieces;
+    size_t n = r->npieces;
+    if (r->store != doc->store) {
+        if (range_import(doc, r, &one) < 0) return -1;
+        src = &one;
+        n = 1;
+    }
+    if (reserve_pieces(doc, doc->npieces + n + 1) < 0) return -1;
+
+    // off 에서 조각을 (필요하면 둘로 쪼개) 벌리고 그 사이에 범위의 조각을 끼운다
+    size_t i = find_piece(doc, off);
+    size_t rel = (i < doc->npieces) ? off - doc->off_prefix[i] : 0;
+    if (rel > 0) {
+        memmove(&doc->pieces[i + n + 2], &doc->pieces[i + 1], (doc->npieces - i - 1) * sizeof(struct piece));
+        doc->pieces[i + n + 1] = doc->pieces[i];
+        doc->pieces[i + n + 1].start += rel;
+        doc->pieces[i + n + 1].len -= rel;
+        doc->pieces[i].len = rel;
+        doc->npieces++;
+        i++;
+    } else {
+        memmove(&doc->pieces[i + n], &doc->pieces[i], (doc->npieces - i) * sizeof(struct piece));
+    }
+    memcpy(&doc->pieces[i], src, n * sizeof(struct piece));
+    doc->npieces += n;
+    invalidate_from(doc, rel > 0 ? i - 1 : i);
+    doc->length += r->len;
+
+    // 알림은 조각마다 이어지는 삽입으로 보낸다. 차례로 적용하면 한 번에 넣은 것과 같다
+    size_t at = off;
+    for (size_t k = 0; k < n; k++) {
+        doc->lf_edits += piece_lf(&src[k]);
+        edited(doc, DOC_EDIT_INSERT, at, src[k].blk->data + src[k].start, src[k].len);
+        at += src[k].len;
+    }
+    return 0;
+}
+
+unsigned long doc_version(document* doc) {
+    return doc->version;
+}
+
+void doc_set_edit_hook(document* doc, doc_edit_fn fn, void* arg) {
+    doc->on_edit = fn;
+    doc->on_edit_arg = arg;
+}
+
+// doc_write 가 조각을 모아 두는 iovec 묶음
+struct write_batch {
+    int fd;
+    int n;
+    struct iovec iov[IOV_MAX];
+};
+
+// 모아 둔 조각을 writev 로 내보낸다. 일부만 써지면 남은 부분부터 다시 쓴다
+static int batch_flush(struct write_batch* wb) {
+    struct iovec* v = wb->iov;
+    int n = wb->n;
+    while (n > 0) {
+        ssize_t w = writev(wb->fd, v, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0) {
+            v->iov_base = (char*)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    wb->n = 0;
+    return 0;
+}
+
+static int batch_chunk(const char* data, size_t len, void* arg) {
+    struct write_batch* wb = arg;
+    wb->iov[wb->n].iov_base = (void*)data;
+    wb->iov[wb->n].iov_len = len;
+    if (++wb->n == IOV_MAX) return batch_flush(wb);
+    return 0;
+}
+
+int doc_write(document* doc, int fd) {
+    struct write_batch* wb = malloc(sizeof(*wb));
+    if (!wb) return -1;
+    wb->fd = fd;
+    wb->n = 0;
+    int r = doc_foreach_chunk(doc, batch_chunk, wb);
+    if (r == 0) r = batch_flush(wb);
+    free(wb);
+    return r ? -1 : 0;
+}
+
+// 대상 파일을 직접 자르지 않고 같은 디렉터리의 임시 파일에 쓴 뒤 rename 으로 바꿔 끼운다.
+// 도중에 죽어도 원본은 그대로 남고, 기존 매핑은 옛 inode 를 계속 가리키므로 안전하다.
+int doc_save(document* doc, const char* path) {
+    char target[PATH_MAX], tmp[PATH_MAX + 16];
+    struct stat st;
+    int have_st = 0;
+
+    // 심볼릭 링크면 링크 자체가 아니라 가리키는 파일을 바꾼다
+    if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode) && realpath(path, target))
+        path = target;
+    if (stat(path, &st) == 0) have_st = 1;
+
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    const char* base = slash ? slash + 1 : path;
+    if (snprintf(tmp, sizeof(tmp), "%.*s.%s.XXXXXX", dir_len, path, base) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) return -1;
+    if (have_st) {
+        fchmod(fd, st.st_mode & 07777);
+        if (fchown(fd, st.st_uid, st.st_gid) < 0) { /* 다른 사용자 파일이면 소유자는 못 바꾼다 */ }
+    } else {
+        fchmod(fd, 0644);
+    }
+    if (doc_write(doc, fd) < 0 || fsync(fd) < 0) goto fail;
+    if (close(fd) < 0) {
+        fd = -1;
+        goto fail;
+    }
+    fd = -1;
+    if (rename(tmp, path) < 0) goto fail;
+
+    // rename 자체가 디스크에 남도록 디렉터리도 fsync
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", dir_len ? dir_len : 1, dir_len ? path : ".");
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+
+fail: {
+        int saved = errno;
+        if (fd >= 0) close(fd);
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+}
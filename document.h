@@ -0,0 +1,68 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stddef.h>
+
+// 피스 테이블 기반 문서 엔진
+// 원본 파일 버퍼(읽기 전용) + 추가 버퍼(append only) 위에 조각(piece) 목록을 두고
+// 삽입/삭제는 조각만 쪼개고 붙인다. 파일 크기와 무관하게 편집 비용이 일정하다.
+typedef struct document document;
+
+// 청크 순회 콜백. 0이 아닌 값을 돌려주면 순회를 멈춘다.
+typedef int (*doc_chunk_fn)(const char* data, size_t len, void* arg);
+
+// 편집 알림 콜백. 성공한 삽입/삭제마다 바이트 오프셋 기준으로 불린다 (삭제는 text 가 지워진 내용)
+#define DOC_EDIT_INSERT 'I'
+#define DOC_EDIT_DELETE 'D'
+typedef void (*doc_edit_fn)(int op, size_t off, const char* text, size_t len, void* arg);
+
+document* doc_new(void);
+document* doc_open(const char* path);   // 실패 시 NULL (errno 유지)
+// 지금 내용을 얼린 읽기 전용 사본. 크기와 무관하게 O(1) 이고 원래 문서를 계속 편집해도 바뀌지 않는다.
+// 만들 때만 원래 문서의 잠금이 필요하고, 이후 다른 스레드에서 읽고 doc_free 로 놓으면 된다 (편집하면 -1)
+document* doc_snapshot(document* doc);
+void doc_free(document* doc);
+
+// 복사한 범위. 내용을 복사하지 않고 문서 블록을 가리키는 조각만 들고 있어 크기와 무관하게
+// 조각 수에 비례하는 시간에 만들고 붙인다. 원래 문서를 편집하거나 닫아도 내용은 그대로다
+typedef struct doc_range doc_range;
+doc_range* doc_copy_range(document* doc, size_t off, size_t len);  // 실패 시 NULL
+size_t doc_range_length(doc_range* r);
+int doc_range_foreach(doc_range* r, doc_chunk_fn fn, void* arg);
+void doc_range_free(doc_range* r);
+// off 에 범위를 끼워 넣는다. 같은 문서(또는 그 스냅숏)에서 복사한 범위는 조각만 이어 붙이고,
+// 다른 문서의 범위는 한 번 복사한다. 편집 알림은 조각마다 이어지는 삽입으로 간다. 실패 시 -1
+int doc_insert_range(document* doc, size_t off, doc_range* r);
+
+size_t doc_length(document* doc);       // 전체 바이트 수
+long doc_line_count(document* doc);     // 항상 1 이상, 큰 파일은 색인이 끝날 때까지 기다림
+int doc_line_exists(document* doc, long line);  // 필요한 만큼만 색인
+const char* doc_eol(document* doc);     // 이 문서의 줄 끝 ("\n" 또는 "\r\n")
+
+// 줄 조회 (줄 번호는 0부터, 길이에는 개행 문자가 포함되지 않음)
+size_t doc_line_offset(document* doc, long line);
+size_t doc_line_length(document* doc, long line);
+long doc_line_at(document* doc, size_t off);    // off 바이트가 들어 있는 줄
+size_t doc_get_line(document* doc, long line, char** buf, size_t* cap);
+
+// 바이트 단위 편집. 성공 시 0, 메모리 부족 시 -1
+int doc_insert(document* doc, size_t off, const char* text, size_t len);
+int doc_delete(document* doc, size_t off, size_t len);
+size_t doc_read(document* doc, size_t off, char* out, size_t len);
+
+// 줄/열 좌표 편의 함수
+int doc_insert_at(document* doc, long line, size_t col, const char* text, size_t len);
+int doc_delete_at(document* doc, long line, size_t col, size_t len);
+
+// 편집 횟수. 저장 시점의 값과 비교하면 변경 여부를 알 수 있다
+unsigned long doc_version(document* doc);
+void doc_set_edit_hook(document* doc, doc_edit_fn fn, void* arg);
+
+// 문서 내용을 앞에서부터 조각 단위로 순회
+int doc_foreach_chunk(document* doc, doc_chunk_fn fn, void* arg);
+// 문서 전체를 fd 에 쓴다. 조각들을 writev 한 번(조각이 많으면 IOV_MAX 개씩)으로 내보냄
+int doc_write(document* doc, int fd);
+// 임시 파일에 쓰고 fsync 후 rename 으로 원자적으로 저장 (권한/소유자 유지). 실패 시 -1 (errno 유지)
+int doc_save(document* doc, const char* path);
+
+#endif
@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "grammar.h"
+#include "keywords.h"
+
+#define MAX_REGIONS 8
+// 여는 구분자 트라이의 상태 수 (구분자 길이의 합 + 1 이면 충분)
+#define MAX_STATES 32
+
+// 구역 플래그
+#define REGION_MULTILINE  1     // 닫는 구분자가 나올 때까지 줄을 넘어 이어진다
+#define REGION_CONTINUE   2     // 줄 끝의 escape 글자로 다음 줄에 이어진다
+#define REGION_LINE_START 4     // 줄의 첫 글자(앞 공백 제외)에서만 열린다
+#define REGION_WORD_START 8     // 줄 처음이나 공백 바로 뒤에서만 열린다
+
+struct region_def {
+    const char* begin;
+    const char* end;            // NULL 이면 줄 끝에서 닫힌다
+    int kind;                   // 구간 색. HL_PLAIN 이면 칠하지 않고 건너뛰기만 한다
+    char escape;                // 이 글자 바로 다음 글자는 닫는 구분자로 보지 않는다
+    int flags;
+};
+
+struct grammar_def {
+    const char* name;
+    const char* files;          // 공백으로 나눈 확장자(".c") 또는 파일 이름("Makefile")
+    int keywords;               // keyword_class 에 넘길 KW_LANG_* (0 이면 키워드 없음)
+    const char* punct;          // HL_PUNCT 로 칠할 글자들
+    struct region_def regions[MAX_REGIONS];
+};
+
+#define C_REGIONS {                                                             \
+    { "//", NULL, HL_COMMENT, '\\', REGION_CONTINUE },                          \
+    { "/*", "*/", HL_COMMENT, 0, REGION_MULTILINE },                            \
+    { "\"", "\"", HL_STRING, '\\', REGION_CONTINUE },                           \
+    { "'", "'", HL_PLAIN, '\\', 0 },                                            \
+    { "#", NULL, HL_PREPROC, '\\', REGION_LINE_START | REGION_CONTINUE },       \
+}
+
+// 새 언어는 여기에 한 줄 더하고 키워드는 keywords.txt 에 적는다. 마지막은 모르는 파일용
+static const struct grammar_def defs[] = {
+    { "C", ".c .h", KW_LANG_C, ";", C_REGIONS },
+    { "C++", ".cpp .cc .cxx .hpp .hh .hxx", KW_LANG_CPP, ";", C_REGIONS },
+    { "Python", ".py", KW_LANG_PYTHON, "", {
+        { "#", NULL, HL_COMMENT, 0, 0 },
+        { "\"\"\"", "\"\"\"", HL_STRING, '\\', REGION_MULTILINE },
+        { "'''", "'''", HL_STRING, '\\', REGION_MULTILINE },
+        { "\"", "\"", HL_STRING, '\\', REGION_CONTINUE },
+        { "'", "'", HL_STRING, '\\', REGION_CONTINUE },
+    } },
+    { "Shell", ".sh .bash", KW_LANG_SH, ";", {
+        { "#", NULL, HL_COMMENT, 0, REGION_WORD_START },
+        { "\"", "\"", HL_STRING, '\\', REGION_MULTILINE },
+        { "'", "'", HL_STRING, 0, REGION_MULTILINE },
+        { "${", "}", HL_PREPROC, 0, 0 },
+    } },
+    { "Makefile", "Makefile makefile GNUmakefile .mk", KW_LANG_MAKE, "", {
+        { "#", NULL, HL_COMMENT, '\\', REGION_CONTINUE },
+        { "$(", ")", HL_PREPROC, 0, 0 },
+        { "${", "}", HL_PREPROC, 0, 0 },
+    } },
+    { "Text", "", 0, "", { { NULL } } },
+};
+
+#define NDEFS (sizeof(defs) / sizeof(defs[0]))
+
+// 바이트 분류
+#define CH_IDENT_START 1
+#define CH_IDENT       2
+#define CH_DIGIT       4
+#define CH_PUNCT       8
+#define CH_BLANK       16
+
+// 구역 안에서 멈춰 볼 글자
+#define STOP_END       1        // 닫는 구분자의 첫 글자
+#define STOP_ESCAPE    2
+
+struct region {
+    const char* end;
+    size_t end_len;
+    int kind, flags;
+    unsigned char stop[256];
+};
+
+struct grammar {
+    const struct grammar_def* def;
+    unsigned char cls[256];
+    // 여는 구분자 트라이를 펼친 전이표. next[상태][바이트], 0 이면 전이 없음 (0 은 시작 상태)
+    unsigned char next[MAX_STATES][256];
+    signed char accept[MAX_STATES];     // 그 상태에서 끝나는 구분자의 구역 번호 (-1 없음)
+    int nstates;
+    struct region regions[MAX_REGIONS];
+    int nregions;
+    int carries;                // 줄을 넘어 이어지는 구역이 있음
+};
+
+static struct grammar grammars[NDEFS];
+static pthread_once_t compile_once = PTHREAD_ONCE_INIT;
+
+static void compile(struct grammar* g, const struct grammar_def* def) {
+    g->def = def;
+    for (int c = 0; c < 256; c++) {
+        if (isalpha(c) || c == '_') g->cls[c] |= CH_IDENT_START | CH_IDENT;
+        if (isdigit(c)) g->cls[c] |= CH_DIGIT | CH_IDENT;
+        if (c == ' ' || c == '\t') g->cls[c] |= CH_BLANK;
+    }
+    for (const char* p = def->punct; *p; p++) g->cls[(unsigned char)*p] |= CH_PUNCT;
+
+    g->nstates = 1;
+    g->accept[0] = -1;
+    for (int r = 0; r < MAX_REGIONS && def->regions[r].begin; r++) {
+        const struct region_def* rd = &def->regions[r];
+        struct region* rg = &g->regions[r];
+        rg->end = rd->end;
+        rg->end_len = rd->end ? strlen(rd->end) : 0;
+        rg->kind = rd->kind;
+        rg->flags = rd->flags;
+        if ((rd->end && (rd->flags & REGION_MULTILINE)) || (rd->flags & REGION_CONTINUE)) g->carries = 1;
+        if (rd->end) rg->stop[(unsigned char)rd->end[0]] |= STOP_END;
+        if (rd->escape) rg->stop[(unsigned char)rd->escape] |= STOP_ESCAPE;
+        g->nregions = r + 1;
+
+        // 여는 구분자를 트라이에 넣는다. 먼저 적힌 구역이 같은 구분자를 가져간다
+        int s = 0;
+        for (const unsigned char* p = (const unsigned char*)rd->begin; *p; p++) {
+            if (!g->next[s][*p]) {
+                if (g->nstates == MAX_STATES) return;
+                g->accept[g->nstates] = -1;
+                g->next[s][*p] = g->nstates++;
+            }
+            s = g->next[s][*p];
+        }
+        if (g->accept[s] < 0) g->accept[s] = r;
+    }
+}
+
+static void compile_all(void) {
+    for (size_t i = 0; i < NDEFS; i++) compile(&grammars[i], &defs[i]);
+}
+
+static int matches(const char* files, const char* name, const char* ext) {
+    size_t n;
+    for (const char* p = files; *p; p += n) {
+        p += strspn(p, " ");
+        n = strcspn(p, " ");
+        const char* want = p[0] == '.' ? ext : name;
+        if (n > 0 && want && strlen(want) == n && strncmp(p, want, n) == 0) return 1;
+    }
+    return 0;
+}
+
+const grammar* grammar_for_path(const char* path) {
+    pthread_once(&compile_once, compile_all);
+    if (!path) return &grammars[0];
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char* ext = strrchr(name, '.');
+    for (size_t i = 0; i + 1 < NDEFS; i++) {
+        if (matches(defs[i].files, name, ext)) return &grammars[i];
+    }
+    return &grammars[NDEFS - 1];
+}
+
+int grammar_carries(const grammar* g) {
+    return g->carries;
+}
+
+static int emit(struct span_buf* out, size_t start, size_t len, int kind) {
+    if (kind == HL_PLAIN || len == 0) return 0;
+    // 바로 앞 구간과 붙어 있고 색이 같으면 늘리기만 한다
+    if (out->n > 0) {
+        struct hl_span* last = &out->items[out->n - 1];
+        if (last->kind == kind && last->start + last->len == start) {
+            last->len += len;
+            return 0;
+        }
+    }
+    if (out->n == out->cap) {
+        int cap = out->cap ? out->cap * 2 : 16;
+        struct hl_span* p = realloc(out->items, cap * sizeof(*p));
+        if (!p) return -1;
+        out->items = p;
+        out->cap = cap;
+    }
+    out->items[out->n++] = (struct hl_span){ (unsigned int)start, (unsigned int)len, kind };
+    return 0;
+}
+
+// s[p..] 에서 구역이 닫힌 바로 뒤를 찾는다. 줄 안에서 닫히지 않으면 len 을 돌려주고
+// *open 에 1 (줄 끝이 escape 글자면 2) 을 담는다
+static size_t region_scan(const struct region* r, const char* s, size_t p, size_t len, int* open) {
+    while (p < len) {
+        unsigned char k = r->stop[(unsigned char)s[p]];
+        if (!k) {
+            p++;
+        } else if (k & STOP_ESCAPE) {
+            p += 2;
+        } else if (len - p >= r->end_len && memcmp(s + p, r->end, r->end_len) == 0) {
+            *open = 0;
+            return p + r->end_len;
+        } else {
+            p++;
+        }
+    }
+    *open = p > len ? 2 : 1;
+    return len;
+}
+
+// 줄 끝까지 닫히지 않은 구역 n 번 다음 줄의 시작 상태
+static int carry(const struct region* r, int n, int open) {
+    if (r->end && (r->flags & REGION_MULTILINE)) return n + 1;
+    if ((r->flags & REGION_CONTINUE) && open == 2) return n + 1;
+    return 0;
+}
+
+int grammar_lex(const grammar* g, const char* s, size_t len, int state, struct span_buf* out) {
+    size_t i = 0;
+    int open;
+    out->n = 0;
+
+    if (state > 0 && state <= g->nregions) {
+        const struct region* r = &g->regions[state - 1];
+        i = region_scan(r, s, 0, len, &open);
+        if (emit(out, 0, i, r->kind) < 0) return -1;
+        if (open) return carry(r, state - 1, open);
+    }
+
+    int blank = i == 0;         // 줄 처음부터 공백만 지나왔음
+    while (i < len) {
+        unsigned char c = s[i];
+        int q = g->next[0][c];
+        if (q) {
+            // 가장 길게 맞는 여는 구분자 (위치 조건을 만족하는 것만)
+            int best = -1;
+            size_t j = i + 1, end = 0;
+            for (;;) {
+                int r = g->accept[q];
+                if (r >= 0 && (!(g->regions[r].flags & REGION_LINE_START) || blank) &&
+                    (!(g->regions[r].flags & REGION_WORD_START) || i == 0 || (g->cls[(unsigned char)s[i - 1]] & CH_BLANK))) {
+                    best = r;
+                    end = j;
+                }
+                if (j == len || !(q = g->next[q][(unsigned char)s[j]])) break;
+                j++;
+            }
+            if (best >= 0) {
+                const struct region* r = &g->regions[best];
+                size_t e = region_scan(r, s, end, len, &open);
+                if (emit(out, i, e - i, r->kind) < 0) return -1;
+                if (open) return carry(r, best, open);
+                i = e;
+                blank = 0;
+                continue;
+            }
+        }
+
+        unsigned char k = g->cls[c];
+        if (k & CH_IDENT) {
+            size_t j = i + 1;
+            while (j < len && (g->cls[(unsigned char)s[j]] & CH_IDENT)) j++;
+            // 숫자로 시작하는 단어(0x1f 등)는 키워드로 보지 않는다
+            if ((k & CH_IDENT_START) && g->def->keywords) {
+                int kind = keyword_class(s + i, j - i, g->def->keywords);
+                kind = kind == KW_TYPE ? HL_TYPE : kind == KW_KEYWORD ? HL_KEYWORD : HL_PLAIN;
+                if (emit(out, i, j - i, kind) < 0) return -1;
+            }
+            i = j;
+        } else {
+            if ((k & CH_PUNCT) && emit(out, i, 1, HL_PUNCT) < 0) return -1;
+            i++;
+        }
+        if (!(k & CH_BLANK)) blank = 0;
+    }
+    return 0;
+}
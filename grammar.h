@@ -0,0 +1,29 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include <stddef.h>
+
+#include "highlight.h"
+
+// 언어 문법
+// 언어마다 주석/문자열 같은 구역의 구분자와 키워드 언어만 표(grammar.c)에 적어 두면,
+// 처음 쓸 때 여는 구분자들을 바이트 단위 상태 전이표(DFA)로 만들어 하나의 분석기로 돌린다.
+// 줄 끝 상태는 0 이 일반, 그 밖에는 줄을 넘어 이어지는 구역 번호 + 1 이다.
+typedef struct grammar grammar;
+
+// 파일 이름(확장자)으로 문법을 고른다. path 가 NULL 이면 C, 모르는 파일이면 강조 없는 문법
+const grammar* grammar_for_path(const char* path);
+
+// 줄 끝 상태가 0 이 아닐 수 있는 문법인지. 아니면 어느 줄이든 상태 0 에서 따로 분석하면 된다
+int grammar_carries(const grammar* g);
+
+// 분석한 구간을 모으는 버퍼
+struct span_buf {
+    struct hl_span* items;
+    int n, cap;
+};
+
+// s[0, len) 한 줄을 state 에서 시작해 분석하고 out 을 채운다. 줄 끝 상태를 돌려준다 (실패 시 -1)
+int grammar_lex(const grammar* g, const char* s, size_t len, int state, struct span_buf* out);
+
+#endif
@@ -0,0 +1,619 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "grep.h"
+#include "search.h"
+#include "lineindex.h"
+
+#define GREP_THREADS_MAX 16
+#define GREP_PREVIEW 200        // 결과 줄을 이만큼까지만 보여 준다
+#define GREP_PROBE 8192         // 앞에서 이만큼 안에 0 바이트가 있으면 바이너리로 본다
+#define GREP_PATH_MAX 4096
+#define CACHE_BUCKETS 4096
+
+// ---- 파일 캐시 ----
+
+struct cached {
+    struct cached* next;        // 같은 버킷의 다음 것
+    struct cached* newer;       // 최근에 쓴 순서 목록
+    struct cached* older;
+    char* path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char* data;                 // 내용 + 끝에 0 (바이너리면 NULL)
+    size_t len;
+    int binary;
+    uint32_t* nl;               // 개행 위치. 처음 결과가 나올 때 만든다 (한 파일은 한 번에 한 스레드만 찾는다)
+    size_t nnl;
+    int refs;                   // 캐시가 쥔 것 하나 + 빌려 간 수
+    unsigned long round;        // 마지막으로 쓴 찾기 차례
+};
+
+static struct cached* buckets[CACHE_BUCKETS];
+static struct cached* newest;   // 가장 최근에 쓴 것. oldest 부터 밀려난다
+static struct cached* oldest;
+static size_t cache_bytes;
+static unsigned long cache_round;   // grep_start 마다 하나씩 는다
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hash_path(const char* s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h % CACHE_BUCKETS;
+}
+
+// cache_lock 을 쥐고 부를 것
+static void drop(struct cached* c) {
+    if (--c->refs > 0) return;
+    free(c->path);
+    free(c->data);
+    free(c->nl);
+    free(c);
+}
+
+// 아래 셋은 cache_lock 을 쥐고 부를 것
+static void lru_remove(struct cached* c) {
+    if (c->newer) c->newer->older = c->older;
+    else newest = c->older;
+    if (c->older) c->older->newer = c->newer;
+    else oldest = c->newer;
+    c->newer = c->older = NULL;
+}
+
+static void lru_push(struct cached* c) {
+    c->older = newest;
+    c->newer = NULL;
+    if (newest) newest->newer = c;
+    else oldest = c;
+    newest = c;
+}
+
+// 버킷과 순서 목록에서 빼고 캐시가 쥔 몫을 놓는다
+static void unlink_cached(struct cached* c) {
+    struct cached** p = &buckets[hash_path(c->path)];
+    while (*p != c) p = &(*p)->next;
+    *p = c->next;
+    lru_remove(c);
+    cache_bytes -= c->len;
+    drop(c);
+}
+
+static int same_file(const struct cached* c, const struct stat* st) {
+    return c->dev == st->st_dev && c->ino == st->st_ino && c->size == st->st_size &&
+           c->mtime.tv_sec == st->st_mtim.tv_sec && c->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// path 를 통째로 읽는다. 앞쪽에 0 바이트가 있으면 내용은 버리고 binary 만 표시한다
+static struct cached* load(const char* path, const struct stat* st) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct cached* c = calloc(1, sizeof(*c));
+    char* data = malloc(st->st_size + 1);
+    size_t len = 0;
+    if (c && data) {
+        while (len < (size_t)st->st_size) {
+            ssize_t n = read(fd, data + len, st->st_size - len);
+            if (n <= 0) break;
+            len += n;
+        }
+    }
+    close(fd);
+    if (!c || !data || !(c->path = strdup(path))) {
+        free(data);
+        free(c);
+        return NULL;
+    }
+    c->dev = st->st_dev;
+    c->ino = st->st_ino;
+    c->size = st->st_size;
+    c->mtime = st->st_mtim;
+    if (memchr(data, 0, len < GREP_PROBE ? len : GREP_PROBE)) {
+        free(data);
+        c->binary = 1;
+    } else {
+        data[len] = 0;
+        c->data = data;
+        c->len = len;
+    }
+    c->refs = 2;                // 캐시 하나, 돌려주는 것 하나
+    return c;
+}
+
+// path 의 내용 (st 와 크기, 수정 시각이 같으면 캐시에 둔 것). 다 쓰면 cache_put 으로 놓는다. 실패 시 NULL
+static struct cached* cache_get(const char* path, const struct stat* st) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached* c = buckets[hash_path(path)];
+    while (c && strcmp(c->path, path) != 0) c = c->next;
+    if (c && same_file(c, st)) {
+        c->refs++;
+        c->round = cache_round;
+        lru_remove(c);
+        lru_push(c);
+        pthread_mutex_unlock(&cache_lock);
+        return c;
+    }
+    if (c) unlink_cached(c);    // 바뀐 파일 (빌려 간 곳이 있으면 놓을 때 사라진다)
+    pthread_mutex_unlock(&cache_lock);
+
+    // 읽기는 잠금 밖에서 한다
+    c = load(path, st);
+    if (!c) return NULL;
+    pthread_mutex_lock(&cache_lock);
+    unsigned b = hash_path(path);
+    c->next = buckets[b];
+    buckets[b] = c;
+    lru_push(c);
+    c->round = cache_round;
+    cache_bytes += c->len;
+    // GREP_CACHE_BYTES 를 넘으면 오래 안 쓴 것부터 버린다. 이번 찾기에서 쓴 것만 남았으면 새것을 넣지 않는다
+    // (캐시보다 큰 디렉터리를 훑을 때 매번 앞쪽을 밀어내서 다음 찾기에서 하나도 맞지 않는 일이 없게)
+    while (cache_bytes > GREP_CACHE_BYTES)
+        unlink_cached(oldest->round != cache_round ? oldest : c);
+    pthread_mutex_unlock(&cache_lock);
+    return c;
+}
+
+static void cache_put(struct cached* c) {
+    pthread_mutex_lock(&cache_lock);
+    drop(c);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void grep_cache_clear(void) {
+    pthread_mutex_lock(&cache_lock);
+    while (oldest) unlink_cached(oldest);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// c 의 개행 위치를 만든다. 실패 시 -1
+static int index_lines(struct cached* c) {
+    if (c->nl) return 0;
+    size_t cap = c->len / 64 + 16, count = 0, from = 0;
+    uint32_t* nl = malloc(cap * sizeof(*nl));
+    int crlf = 0;
+    while (nl && from < c->len) {
+        if (count == cap) {
+            uint32_t* p = realloc(nl, cap * 2 * sizeof(*nl));
+            if (!p) break;
+            nl = p;
+            cap *= 2;
+        }
+        count += line_index_scan(c->data, from, c->len, nl + count, cap - count, &from, &crlf);
+    }
+    if (!nl || from < c->len) {
+        free(nl);
+        return -1;
+    }
+    c->nl = nl;
+    c->nnl = count;
+    return 0;
+}
+
+// ---- .gitignore ----
+
+struct rule {
+    char* base;                 // 규칙을 적은 .gitignore 의 디렉터리 (root 기준, 빈 문자열이거나 '/' 로 끝남)
+    char* pat;
+    int negate;                 // '!' 로 시작: 앞 규칙이 무시한 것을 되살린다
+    int dir_only;               // '/' 로 끝남: 디렉터리에만 맞는다
+    int anchored;               // 중간에 '/' 가 있음: base 기준 경로 전체에 맞춘다 (없으면 이름에만)
+};
+
+struct rules {
+    struct rule* v;
+    int n, cap;
+};
+
+static void add_rule(struct rules* r, const char* base, char* line) {
+    size_t n = strlen(line);
+    while (n > 0 && (line[n - 1] == '\r' || line[n - 1] == ' ' || line[n - 1] == '\n')) line[--n] = 0;
+    if (n == 0 || line[0] == '#') return;
+    struct rule x = {0};
+    if (line[0] == '!') {
+        x.negate = 1;
+        line++;
+    } else if (line[0] == '\\') {
+        line++;
+    }
+    n = strlen(line);
+    if (n > 0 && line[n - 1] == '/') {
+        x.dir_only = 1;
+        line[--n] = 0;
+    }
+    if (strchr(line, '/')) {
+        x.anchored = 1;
+        if (line[0] == '/') line++;
+    }
+    if (!*line) return;
+    if (r->n == r->cap) {
+        int cap = r->cap ? r->cap * 2 : 32;
+        struct rule* v = realloc(r->v, cap * sizeof(*v));
+        if (!v) return;
+        r->v = v;
+        r->cap = cap;
+    }
+    x.base = strdup(base);
+    x.pat = strdup(line);
+    if (!x.base || !x.pat) {
+        free(x.base);
+        free(x.pat);
+        return;
+    }
+    r->v[r->n++] = x;
+}
+
+static void pop_rules(struct rules* r, int n) {
+    while (r->n > n) {
+        r->n--;
+        free(r->v[r->n].base);
+        free(r->v[r->n].pat);
+    }
+}
+
+static int rule_matches(const struct rule* r, const char* rel, const char* name, int is_dir) {
+    if (r->dir_only && !is_dir) return 0;
+    size_t bl = strlen(r->base);
+    if (strncmp(rel, r->base, bl) != 0) return 0;
+    if (!r->anchored) return fnmatch(r->pat, name, 0) == 0;
+    // "**" 는 '/' 를 넘어 맞아야 하므로 FNM_PATHNAME 없이 맞춘다. 앞의 "**/" 는 없어도 된다
+    const char* sub = rel + bl;
+    if (!strstr(r->pat, "**")) return fnmatch(r->pat, sub, FNM_PATHNAME) == 0;
+    if (strncmp(r->pat, "**/", 3) == 0 && fnmatch(r->pat + 3, sub, 0) == 0) return 1;
+    return fnmatch(r->pat, sub, 0) == 0;
+}
+
+// 마지막으로 맞는 규칙이 정한다
+static int ignored(const struct rules* r, const char* rel, const char* name, int is_dir) {
+    int result = 0;
+    for (int i = 0; i < r->n; i++)
+        if (rule_matches(&r->v[i], rel, name, is_dir)) result = !r->v[i].negate;
+    return result;
+}
+
+// ---- 찾기 ----
+
+struct grep {
+    char* root;
+    char* query;
+    size_t len;
+    pattern* re;
+
+    // 훑는 스레드가 넣고 찾는 스레드들이 앞에서부터 꺼내 가는 파일 목록 (root 기준 경로)
+    char** paths;
+    long npaths, paths_cap, next_path;
+    int walked;                 // 디렉터리를 다 훑었다
+    int busy;                   // 파일을 찾고 있는 스레드 수
+
+    struct grep_hit* hits;
+    long count, hits_cap;
+    long files;
+    int truncated, stop;
+    unsigned long changes;
+
+    pthread_mutex_t lock;
+    pthread_cond_t more;        // 찾을 파일이 늘었거나 다 훑었다
+    pthread_t walker;
+    int walker_started;
+    pthread_t workers[GREP_THREADS_MAX];
+    int nworkers;
+};
+
+static int stopped(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    int s = g->stop;
+    pthread_mutex_unlock(&g->lock);
+    return s;
+}
+
+// root 기준 경로 rel 을 열 수 있는 경로로
+static void full_path(grep* g, const char* rel, char* out) {
+    if (strcmp(g->root, ".") == 0) snprintf(out, GREP_PATH_MAX, "%s", *rel ? rel : ".");
+    else snprintf(out, GREP_PATH_MAX, "%s/%s", g->root, rel);
+}
+
+static void push_path(grep* g, const char* rel) {
+    char* p = strdup(rel);
+    if (!p) return;
+    pthread_mutex_lock(&g->lock);
+    if (g->npaths == g->paths_cap) {
+        long cap = g->paths_cap ? g->paths_cap * 2 : 256;
+        char** v = realloc(g->paths, cap * sizeof(*v));
+        if (!v) {
+            pthread_mutex_unlock(&g->lock);
+            free(p);
+            return;
+        }
+        g->paths = v;
+        g->paths_cap = cap;
+    }
+    g->paths[g->npaths++] = p;
+    pthread_cond_signal(&g->more);
+    pthread_mutex_unlock(&g->lock);
+}
+
+static void load_rules(grep* g, struct rules* r, const char* rel) {
+    char name[GREP_PATH_MAX], path[GREP_PATH_MAX];
+    snprintf(name, sizeof(name), "%s.gitignore", rel);
+    full_path(g, name, path);
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) add_rule(r, rel, line);
+    fclose(f);
+}
+
+// rel ("" 이거나 '/' 로 끝나는 디렉터리) 아래를 이름 순으로 훑는다. 심볼릭 링크는 따라가지 않는다
+static void walk(grep* g, struct rules* r, const char* rel) {
+    char dir[GREP_PATH_MAX];
+    full_path(g, rel, dir);
+    struct dirent** list;
+    int n = scandir(dir, &list, NULL, alphasort);
+    if (n < 0) return;
+    int mark = r->n;
+    load_rules(g, r, rel);
+    for (int i = 0; i < n; i++) {
+        const char* name = list[i]->d_name;
+        int type = list[i]->d_type;
+        char path[GREP_PATH_MAX];
+        size_t nl = strlen(name);
+        int skip = strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0 ||
+                   (name[0] == '.' && nl > 4 && strcmp(name + nl - 4, ".swp") == 0) ||   // 편집 저널
+                   (name[0] == '.' && nl > 5 && strcmp(name + nl - 5, ".undo") == 0) ||  // 되돌리기 기록
+                   strlen(rel) + nl + 2 > sizeof(path) || stopped(g);
+        if (!skip) {
+            snprintf(path, sizeof(path), "%s%s", rel, name);
+            if (type == DT_UNKNOWN) {
+                char full[GREP_PATH_MAX];
+                struct stat st;
+                full_path(g, path, full);
+                if (lstat(full, &st) == 0) type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+            if (type == DT_DIR && !ignored(r, path, name, 1)) {
+                strcat(path, "/");
+                walk(g, r, path);
+            } else if (type == DT_REG && !ignored(r, path, name, 0)) {
+                push_path(g, path);
+            }
+        }
+        free(list[i]);
+    }
+    free(list);
+    pop_rules(r, mark);
+}
+
+static void* grep_walker(void* arg) {
+    grep* g = arg;
+    struct rules r = {0};
+    walk(g, &r, "");
+    pop_rules(&r, 0);
+    free(r.v);
+    pthread_mutex_lock(&g->lock);
+    g->walked = 1;
+    g->changes++;
+    pthread_cond_broadcast(&g->more);
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+// c 의 [a, b) 를 결과에 더한다. GREP_MAX_HITS 에 닿았으면 -1
+static int add_hit(grep* g, struct cached* c, const char* rel, size_t a, size_t b) {
+    if (index_lines(c) < 0) return -1;
+    size_t lo = 0, hi = c->nnl;             // a 앞에 있는 개행 수 = 줄 번호
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c->nl[mid] < a) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t start = lo ? c->nl[lo - 1] + 1 : 0;
+    size_t end = lo < c->nnl ? c->nl[lo] : c->len;
+    if (end > start && c->data[end - 1] == '\r') end--;
+    if (end - start > GREP_PREVIEW) end = start + GREP_PREVIEW;
+    char* preview = malloc(end - start + 1);
+    if (!preview) return -1;
+    for (size_t i = start; i < end; i++) {
+        unsigned char ch = c->data[i];
+        preview[i - start] = ch < ' ' || ch == 127 ? ' ' : ch;
+    }
+    preview[end - start] = 0;
+
+    pthread_mutex_lock(&g->lock);
+    if (g->count >= GREP_MAX_HITS) {
+        g->truncated = 1;
+        g->stop = 1;
+        pthread_cond_broadcast(&g->more);
+        pthread_mutex_unlock(&g->lock);
+        free(preview);
+        return -1;
+    }
+    if (g->count == g->hits_cap) {
+        long cap = g->hits_cap ? g->hits_cap * 2 : 256;
+        struct grep_hit* v = realloc(g->hits, cap * sizeof(*v));
+        if (!v) {
+            pthread_mutex_unlock(&g->lock);
+            free(preview);
+            return -1;
+        }
+        g->hits = v;
+        g->hits_cap = cap;
+    }
+    g->hits[g->count++] = (struct grep_hit){rel, (long)lo, (long)(a - start), (long)(b - a), preview};
+    g->changes++;
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+static void search_file(grep* g, const char* rel, pattern* re) {
+    char path[GREP_PATH_MAX];
+    struct stat st;
+    full_path(g, rel, path);
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > GREP_FILE_MAX) return;
+    struct cached* c = cache_get(path, &st);
+    if (!c) return;
+    size_t from = 0;
+    while (c->data && !stopped(g)) {
+        size_t a, b;
+        if (re) {
+            struct pattern_match m;
+            if (from > c->len || !pattern_exec(re, c->data, from, c->len, &m)) break;
+            a = m.start[0];
+            b = m.end[0];
+        } else {
+            a = search_find_literal(c->data, from, c->len, g->query, g->len);
+            if (a >= c->len) break;
+            b = a + g->len;
+        }
+        if (add_hit(g, c, rel, a, b) < 0) break;
+        // 다음 일치는 이 일치 뒤에서 (빈 일치면 다음 줄부터)
+        if (b > a) {
+            from = b;
+        } else {
+            const char* nl = memchr(c->data + a, '\n', c->len - a);
+            if (!nl) break;
+            from = nl - c->data + 1;
+        }
+    }
+    cache_put(c);
+}
+
+static void* grep_worker(void* arg) {
+    grep* g = arg;
+    // regexec 은 패턴마다 잠금을 잡으므로 스레드마다 사본을 쓴다
+    pattern* re = g->re ? pattern_clone(g->re) : NULL;
+    pthread_mutex_lock(&g->lock);
+    if (g->re && !re) {
+        pthread_mutex_unlock(&g->lock);
+        return NULL;
+    }
+    for (;;) {
+        while (!g->stop && !g->walked && g->next_path == g->npaths) pthread_cond_wait(&g->more, &g->lock);
+        if (g->stop || g->next_path == g->npaths) break;
+        const char* rel = g->paths[g->next_path++];
+        g->busy++;
+        pthread_mutex_unlock(&g->lock);
+        search_file(g, rel, re);
+        pthread_mutex_lock(&g->lock);
+        g->busy--;
+        g->files++;
+        g->changes++;
+    }
+    pthread_mutex_unlock(&g->lock);
+    pattern_release(re);
+    return NULL;
+}
+
+static int thread_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > GREP_THREADS_MAX) n = GREP_THREADS_MAX;
+    return n;
+}
+
+grep* grep_start(const char* root, const char* query, size_t len, pattern* re) {
+    if (!re && len == 0) return NULL;
+    grep* g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->root = strdup(root);
+    g->query = malloc(len + 1);
+    if (!g->root || !g->query) {
+        free(g->root);
+        free(g->query);
+        free(g);
+        return NULL;
+    }
+    memcpy(g->query, query, len);
+    g->query[len] = 0;
+    g->len = len;
+    if (re) pattern_retain(re);
+    g->re = re;
+    pthread_mutex_lock(&cache_lock);
+    cache_round++;
+    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->more, NULL);
+
+    if (pthread_create(&g->walker, NULL, grep_walker, g) != 0) {
+        grep_free(g);
+        return NULL;
+    }
+    g->walker_started = 1;
+    int n = thread_count();
+    while (g->nworkers < n && pthread_create(&g->workers[g->nworkers], NULL, grep_worker, g) == 0) g->nworkers++;
+    if (g->nworkers == 0) {
+        grep_free(g);
+        return NULL;
+    }
+    return g;
+}
+
+void grep_free(grep* g) {
+    if (!g) return;
+    pthread_mutex_lock(&g->lock);
+    g->stop = 1;
+    pthread_cond_broadcast(&g->more);
+    pthread_mutex_unlock(&g->lock);
+    if (g->walker_started) pthread_join(g->walker, NULL);
+    for (int i = 0; i < g->nworkers; i++) pthread_join(g->workers[i], NULL);
+    for (long i = 0; i < g->count; i++) free((char*)g->hits[i].preview);
+    for (long i = 0; i < g->npaths; i++) free(g->paths[i]);
+    free(g->hits);
+    free(g->paths);
+    pattern_release(g->re);
+    free(g->query);
+    free(g->root);
+    pthread_cond_destroy(&g->more);
+    pthread_mutex_destroy(&g->lock);
+    free(g);
+}
+
+int grep_done(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    int done = g->busy == 0 && (g->stop || (g->walked && g->next_path == g->npaths));
+    pthread_mutex_unlock(&g->lock);
+    return done;
+}
+
+long grep_count(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    long n = g->count;
+    pthread_mutex_unlock(&g->lock);
+    return n;
+}
+
+int grep_hit(grep* g, long i, struct grep_hit* out) {
+    pthread_mutex_lock(&g->lock);
+    int ok = i >= 0 && i < g->count;
+    if (ok) *out = g->hits[i];
+    pthread_mutex_unlock(&g->lock);
+    return ok ? 0 : -1;
+}
+
+long grep_files(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    long n = g->files;
+    pthread_mutex_unlock(&g->lock);
+    return n;
+}
+
+int grep_truncated(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    int t = g->truncated;
+    pthread_mutex_unlock(&g->lock);
+    return t;
+}
+
+unsigned long grep_changes(grep* g) {
+    pthread_mutex_lock(&g->lock);
+    unsigned long c = g->changes;
+    pthread_mutex_unlock(&g->lock);
+    return c;
+}
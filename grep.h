@@ -0,0 +1,42 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stddef.h>
+
+#include "pattern.h"
+
+// 여러 파일에서 찾기 (Find in Files)
+// 한 스레드가 root 아래 디렉터리를 훑으며 찾을 파일을 대고(.gitignore 에 걸린 곳, .git, 스왑 파일과 되돌리기 기록은 건너뜀),
+// 코어 수만큼의 스레드가 파일을 하나씩 가져가 찾는다 (앞쪽에 0 바이트가 있는 바이너리는 건너뜀).
+// 결과는 찾는 대로 쌓이므로 다 끝나기 전에도 읽을 수 있다. 파일 내용과 줄 색인은 크기와 수정 시각이
+// 같은 동안 캐시해 두어, 같은 파일을 다시 찾을 때는 읽지도 줄을 다시 세지도 않는다.
+typedef struct grep grep;
+
+struct grep_hit {
+    const char* path;           // root 기준 경로 (grep_free 까지 유효)
+    long line;                  // 0 부터
+    long col;                   // 줄 안의 바이트 위치
+    long len;                   // 일치 길이
+    const char* preview;        // 그 줄의 앞부분 (제어 문자는 공백으로)
+};
+
+#define GREP_MAX_HITS 20000                     // 이만큼 모으면 더 찾지 않는다
+#define GREP_FILE_MAX (256L * 1024 * 1024)      // 이보다 큰 파일은 건너뛴다
+#define GREP_CACHE_BYTES (256L * 1024 * 1024)   // 캐시에 두는 파일 내용의 합
+
+// root 아래에서 query[0, len) 을 (re 가 있으면 정규식 re 로) 찾기 시작한다. 실패 시 NULL
+grep* grep_start(const char* root, const char* query, size_t len, pattern* re);
+// 찾기를 멈추고 스레드를 거둔 뒤 결과를 놓는다
+void grep_free(grep* g);
+
+int grep_done(grep* g);
+long grep_count(grep* g);
+int grep_hit(grep* g, long i, struct grep_hit* out);   // i 번째 결과를 out 에 담는다 (없으면 -1)
+long grep_files(grep* g);               // 지금까지 찾아 본 파일 수
+int grep_truncated(grep* g);            // GREP_MAX_HITS 에 닿아 멈췄다
+unsigned long grep_changes(grep* g);    // 결과나 찾아 본 파일 수가 늘 때마다 바뀐다 (다시 그릴지 정할 때)
+
+// 파일 캐시를 비운다 (찾는 중인 것이 없을 때 부를 것)
+void grep_cache_clear(void);
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "highlight.h"
+#include "grammar.h"
+
+// 뒤에서 한 번에 분석하는 줄 수와 시간 (그동안만 문서 잠금 없이 돈다)
+#define HL_SLICE_LINES 65536
+#define HL_SLICE_NS 8000000L
+// 편집이 이만큼 잠잠해진 뒤에 아래쪽 줄들을 다시 확인한다
+#define HL_IDLE_MS 300
+// 확인된 곳에서 이만큼 안쪽 줄은 UI 스레드가 바로 분석한다
+#define HL_NEAR_LINES 2000
+// 멀리 뛰었을 때 스레드를 기다리는 최대 시간
+#define HL_WAIT_MS 50
+
+struct hl_line {
+    struct hl_span* spans;
+    int nspans;
+    unsigned char start;        // 분석할 때 들어온 상태
+    unsigned char end;          // 줄 끝 상태
+    unsigned char known;        // 0 이면 편집되었거나 아직 분석하지 않은 줄, 2 면 상태만 앎 (구간 없음)
+};
+
+// 스레드가 잠금 없이 분석하는 동안 참고하는 캐시 사본
+struct hl_hint {
+    unsigned char known, start, end;
+};
+
+struct highlighter {
+    const grammar* grammar;
+    struct hl_line* lines;      // 0번 줄부터 분석한 데까지
+    long count, cap;
+    long valid;                 // [0, valid) 줄은 들어오는 상태까지 확인됨
+
+    char* text;                 // 줄 읽기 버퍼
+    size_t text_cap;
+    struct span_buf tmp;        // 분석 중인 줄의 구간
+
+    // 화면보다 앞서 상태를 계산하는 스레드 (highlight_start)
+    pthread_mutex_t* lock;      // 문서 잠금. NULL 이면 스레드 없음
+    pthread_t worker;
+    pthread_cond_t wake;        // 할 일이 생겼을 때
+    pthread_cond_t progress;    // 스레드가 결과를 붙였을 때
+    document* doc;
+    int stop;
+    int done;                   // 문서 끝까지 확인했음
+    unsigned long epoch;        // 문서를 바꿀 때마다 증가
+    unsigned long generation;   // 스레드가 결과를 붙일 때마다 증가
+    unsigned long waited;       // 이 generation 에서는 더 기다리지 않는다
+    long edit_floor;            // 스레드가 분석하는 동안 편집된 가장 위 줄
+    struct timespec quiet;      // 이 시각이 지나면 분석을 시작한다
+
+    // 스레드 전용 버퍼
+    struct hl_hint* hint;
+    unsigned char* ends;
+    char* wtext;
+    size_t wtext_cap;
+    struct span_buf wspans;
+};
+
+highlighter* highlight_new(void) {
+    highlighter* h = calloc(1, sizeof(*h));
+    if (h) h->grammar = grammar_for_path(NULL);
+    return h;
+}
+
+static void clear_lines(highlighter* h) {
+    for (long i = 0; i < h->count; i++) free(h->lines[i].spans);
+    h->count = 0;
+    h->valid = 0;
+}
+
+static void after_ms(struct timespec* ts, long ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += ms % 1000 * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+void highlight_reset(highlighter* h, document* doc, const grammar* g) {
+    clear_lines(h);
+    h->grammar = g;
+    h->doc = doc;
+    h->epoch++;
+    h->generation++;
+    h->done = 0;
+    h->edit_floor = 0;
+    after_ms(&h->quiet, 0);
+    if (h->lock) pthread_cond_signal(&h->wake);
+}
+
+void highlight_edit(highlighter* h, long line, long removed, long added) {
+    if (h->valid > line) h->valid = line;
+    if (h->edit_floor > line) h->edit_floor = line;
+    h->done = 0;
+    after_ms(&h->quiet, HL_IDLE_MS);
+    if (h->lock) pthread_cond_signal(&h->wake);
+    if (line >= h->count) return;
+
+    // 캐시 끝을 넘어가는 편집이면 그 줄부터 버린다
+    long old_end = line + removed + 1;
+    if (old_end >= h->count) {
+        for (long i = line; i < h->count; i++) free(h->lines[i].spans);
+        h->count = line;
+        return;
+    }
+
+    long count = h->count + added - removed;
+    if (count > h->cap) {
+        long cap = h->cap * 2;
+        if (cap < count) cap = count;
+        struct hl_line* p = realloc(h->lines, cap * sizeof(*p));
+        if (!p) {
+            // 뒤쪽 캐시를 포기하고 편집한 줄부터 다시 분석한다
+            for (long i = line; i < h->count; i++) free(h->lines[i].spans);
+            h->count = line;
+            return;
+        }
+        h->lines = p;
+        h->cap = cap;
+    }
+    for (long i = line; i < old_end; i++) free(h->lines[i].spans);
+    // 아래쪽 줄은 내용이 그대로이므로 자리만 옮기고, 바뀐 줄들은 모르는 줄로 둔다
+    memmove(&h->lines[line + added + 1], &h->lines[old_end], (h->count - old_end) * sizeof(*h->lines));
+    memset(&h->lines[line], 0, (added + 1) * sizeof(*h->lines));
+    h->count = count;
+}
+
+static int reserve(highlighter* h, long count) {
+    if (count <= h->cap) return 0;
+    long cap = h->cap ? h->cap * 2 : 256;
+    if (cap < count) cap = count;
+    struct hl_line* p = realloc(h->lines, cap * sizeof(*p));
+    if (!p) return -1;
+    h->lines = p;
+    h->cap = cap;
+    return 0;
+}
+
+// 스레드가 [from, from + n) 줄의 줄 끝 상태를 계산했다. 잠금을 쥔 채로 캐시에 붙인다
+static int publish(highlighter* h, long from, long n, int state) {
+    if (reserve(h, from + n) < 0) return -1;
+    for (long i = h->count; i < from + n; i++) memset(&h->lines[i], 0, sizeof(*h->lines));
+    if (h->count < from + n) h->count = from + n;
+    for (long k = 0; k < n; k++) {
+        int in = k > 0 ? h->ends[k - 1] : state;
+        struct hl_line* l = &h->lines[from + k];
+        // 구간까지 아는 줄은 그대로 두고, 나머지는 화면에 나올 때 구간만 채운다
+        if (l->known && l->start == in && l->end == h->ends[k]) continue;
+        free(l->spans);
+        *l = (struct hl_line){ NULL, 0, in, h->ends[k], 2 };
+    }
+    if (h->valid < from + n) h->valid = from + n;
+    return 0;
+}
+
+static long elapsed_ns(const struct timespec* t0) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) * 1000000000L + (t.tv_nsec - t0->tv_nsec);
+}
+
+// 확인된 곳 다음부터 한 조각씩, 문서 스냅샷 위에서 잠금 없이 줄 끝 상태를 계산한다
+static void* worker_main(void* arg) {
+    highlighter* h = arg;
+    pthread_mutex_lock(h->lock);
+    while (!h->stop) {
+        if (h->done || !h->doc || !grammar_carries(h->grammar)) {
+            pthread_cond_wait(&h->wake, h->lock);
+            continue;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (now.tv_sec < h->quiet.tv_sec || (now.tv_sec == h->quiet.tv_sec && now.tv_nsec < h->quiet.tv_nsec)) {
+            pthread_cond_timedwait(&h->wake, h->lock, &h->quiet);
+            continue;
+        }
+
+        long from = h->valid;
+        int state = from > 0 ? h->lines[from - 1].end : 0;
+        long cached = h->count - from;
+        if (cached > HL_SLICE_LINES) cached = HL_SLICE_LINES;
+        for (long k = 0; k < cached; k++) {
+            struct hl_line* l = &h->lines[from + k];
+            h->hint[k] = (struct hl_hint){ l->known, l->start, l->end };
+        }
+        document* snap = doc_snapshot(h->doc);
+        if (!snap) {
+            h->done = 1;        // 다음 편집 때 다시 해 본다
+            continue;
+        }
+        const grammar* g = h->grammar;
+        unsigned long epoch = h->epoch;
+        h->edit_floor = LONG_MAX;
+        pthread_mutex_unlock(h->lock);
+
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        long n = 0;
+        int eof = 0, st = state;
+        while (n < HL_SLICE_LINES) {
+            if (!doc_line_exists(snap, from + n)) {
+                eof = 1;
+                break;
+            }
+            // 내용이 그대로이고 같은 상태로 들어오는 줄은 캐시의 줄 끝 상태를 쓴다
+            if (n < cached && h->hint[n].known && h->hint[n].start == st) {
+                st = h->hint[n].end;
+            } else {
+                size_t len = doc_get_line(snap, from + n, &h->wtext, &h->wtext_cap);
+                st = grammar_lex(g, h->wtext, len, st, &h->wspans);
+                if (st < 0) break;
+            }
+            h->ends[n++] = st;
+            if (n % 1024 == 0 && elapsed_ns(&t0) > HL_SLICE_NS) break;
+        }
+        doc_free(snap);
+
+        pthread_mutex_lock(h->lock);
+        // 그사이 문서가 바뀌었거나 분석한 줄이 편집되었으면 버린다
+        if (h->epoch != epoch || h->edit_floor < from + n) continue;
+        if ((st < 0 && n == 0) || publish(h, from, n, state) < 0) {
+            h->done = 1;
+            continue;
+        }
+        if (eof && h->edit_floor == LONG_MAX) h->done = 1;
+        h->generation++;
+        pthread_cond_broadcast(&h->progress);
+    }
+    pthread_mutex_unlock(h->lock);
+    return NULL;
+}
+
+int highlight_start(highlighter* h, pthread_mutex_t* lock) {
+    h->hint = malloc(HL_SLICE_LINES * sizeof(*h->hint));
+    h->ends = malloc(HL_SLICE_LINES);
+    if (!h->hint || !h->ends) return -1;
+    pthread_cond_init(&h->wake, NULL);
+    pthread_cond_init(&h->progress, NULL);
+    h->lock = lock;
+    if (pthread_create(&h->worker, NULL, worker_main, h) != 0) {
+        h->lock = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+unsigned long highlight_generation(highlighter* h) {
+    return h->generation;
+}
+
+void highlight_free(highlighter* h) {
+    if (!h) return;
+    if (h->lock) {
+        pthread_mutex_lock(h->lock);
+        h->stop = 1;
+        pthread_cond_signal(&h->wake);
+        pthread_mutex_unlock(h->lock);
+        pthread_join(h->worker, NULL);
+        pthread_cond_destroy(&h->wake);
+        pthread_cond_destroy(&h->progress);
+    }
+    clear_lines(h);
+    free(h->lines);
+    free(h->text);
+    free(h->tmp.items);
+    free(h->hint);
+    free(h->ends);
+    free(h->wtext);
+    free(h->wspans.items);
+    free(h);
+}
+
+// 줄 하나를 다시 분석해 캐시에 넣는다
+static int lex_line(highlighter* h, document* doc, long line, int state) {
+    size_t len = doc_get_line(doc, line, &h->text, &h->text_cap);
+    int end = grammar_lex(h->grammar, h->text, len, state, &h->tmp);
+    if (end < 0) return -1;
+
+    struct hl_line* l = &h->lines[line];
+    struct hl_span* spans = NULL;
+    if (h->tmp.n > 0) {
+        spans = realloc(l->spans, h->tmp.n * sizeof(*spans));
+        if (!spans) return -1;
+        memcpy(spans, h->tmp.items, h->tmp.n * sizeof(*spans));
+    } else {
+        free(l->spans);
+    }
+    l->spans = spans;
+    l->nspans = h->tmp.n;
+    l->start = state;
+    l->end = end;
+    l->known = 1;
+    return 0;
+}
+
+// 캐시에 넣지 않고 state 에서 시작해 분석한 구간을 돌려준다
+static int lex_uncached(highlighter* h, document* doc, long line, int state, const struct hl_span** spans) {
+    size_t len = doc_get_line(doc, line, &h->text, &h->text_cap);
+    if (grammar_lex(h->grammar, h->text, len, state, &h->tmp) < 0) return -1;
+    *spans = h->tmp.items;
+    return h->tmp.n;
+}
+
+int highlight_line(highlighter* h, document* doc, long line, const struct hl_span** spans, int* state) {
+    if (line < 0 || !doc_line_exists(doc, line)) return -1;
+
+    // 줄을 넘는 구역이 없는 문법은 어느 줄이든 따로 분석하면 된다
+    if (!grammar_carries(h->grammar)) {
+        *state = 0;
+        return lex_uncached(h, doc, line, 0, spans);
+    }
+
+    // 멀리 뛰었으면 앞쪽을 여기서 분석하지 않고 스레드가 따라올 때까지 잠깐 기다린다.
+    // 그래도 못 따라오면 임시로 상태 0 에서 분석해 보여 주고, 결과가 붙으면 다시 그린다
+    if (h->lock && line - h->valid > HL_NEAR_LINES) {
+        after_ms(&h->quiet, 0);
+        pthread_cond_signal(&h->wake);
+        if (h->waited != h->generation) {
+            struct timespec deadline;
+            after_ms(&deadline, HL_WAIT_MS);
+            while (line - h->valid > HL_NEAR_LINES && !h->done &&
+                   pthread_cond_timedwait(&h->progress, h->lock, &deadline) == 0) {
+            }
+            if (line - h->valid > HL_NEAR_LINES) h->waited = h->generation;
+        }
+        if (line - h->valid > HL_NEAR_LINES) {
+            *state = -1;
+            return lex_uncached(h, doc, line, 0, spans);
+        }
+    }
+
+    // 확인된 곳부터 line 까지 내려가며 들어오는 상태가 달라진 줄만 다시 분석한다.
+    // 편집 아래쪽은 줄 끝 상태가 예전과 같아지는 순간부터 캐시를 그대로 쓴다
+    while (h->valid <= line) {
+        long i = h->valid;
+        int in = i > 0 ? h->lines[i - 1].end : 0;
+        if (i == h->count) {
+            if (reserve(h, h->count + 1) < 0) return -1;
+            memset(&h->lines[h->count++], 0, sizeof(*h->lines));
+        }
+        struct hl_line* l = &h->lines[i];
+        if ((!l->known || l->start != in) && lex_line(h, doc, i, in) < 0) return -1;
+        h->valid++;
+    }
+
+    // 스레드가 상태만 채운 줄이면 구간을 채운다
+    struct hl_line* l = &h->lines[line];
+    if (l->known == 2 && lex_line(h, doc, line, l->start) < 0) return -1;
+    *spans = l->spans;
+    *state = l->start;
+    return l->nspans;
+}
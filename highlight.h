@@ -0,0 +1,55 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "document.h"
+
+// 줄 단위 구문 강조 캐시
+// 줄마다 토큰 구간과 줄 끝의 렉서 상태(블록 주석/문자열 안인지 등, grammar.h)를 기억해 두고,
+// 편집이 있으면 그 줄부터 아래로 들어오는 상태가 달라진 줄만 다시 분석한다.
+// 위쪽 줄은 상태가 정해진 곳까지만, 아래쪽 줄은 화면에 필요한 만큼만 분석한다.
+// highlight_start 로 스레드를 띄우면 편집이 잠잠할 때 화면 아래쪽 줄들의 상태를 조금씩 미리 계산해 두어,
+// 먼 줄로 뛰어도 처음부터 다시 분석하지 않는다.
+typedef struct highlighter highlighter;
+
+// 토큰 종류 (구간이 없는 곳은 일반 글자)
+enum {
+    HL_PLAIN,
+    HL_STRING,
+    HL_PREPROC,
+    HL_COMMENT,
+    HL_PUNCT,       // 세미콜론
+    HL_KEYWORD,     // 제어문/한정자 (마젠타)
+    HL_TYPE,        // 자료형/할당 함수 (시안)
+};
+
+struct hl_span {
+    unsigned int start, len;
+    int kind;
+};
+
+struct grammar;
+
+highlighter* highlight_new(void);
+// 스레드가 돌고 있으면 멈춘 뒤 해제한다 (lock 을 쥐지 않은 채로 부를 것)
+void highlight_free(highlighter* h);
+// 다른 문서를 열었을 때. 그 문서와 문법으로 바꾸고 캐시를 비운다
+void highlight_reset(highlighter* h, document* doc, const struct grammar* g);
+
+// 미리 계산하는 스레드를 띄운다. lock 은 문서를 지키는 잠금이고, 띄운 뒤로는
+// 다른 highlight_* 함수를 모두 이 잠금을 쥔 채로 불러야 한다. 실패하면 -1 (스레드 없이 동작)
+int highlight_start(highlighter* h, pthread_mutex_t* lock);
+// 스레드가 결과를 붙이거나 문서가 바뀔 때마다 늘어난다. 달라졌으면 화면을 다시 맞춘다
+unsigned long highlight_generation(highlighter* h);
+
+// line 줄에서 시작해 개행 removed 개가 지워지고 added 개가 들어온 편집을 알린다
+void highlight_edit(highlighter* h, long line, long removed, long added);
+
+// line 줄의 토큰 구간과 그 줄이 시작하는 렉서 상태. 구간 수를 돌려준다 (줄이 없거나 실패하면 -1)
+// 스레드가 아직 따라오지 못한 먼 줄이면 잠깐 기다리고, 그래도 모자라면 임시 구간과 상태 -1 을 준다
+// 돌려준 구간은 다음 highlight_* 호출까지 유효하다
+int highlight_line(highlighter* h, document* doc, long line, const struct hl_span** spans, int* state);
+
+#endif
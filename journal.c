@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+#define SWAP_MAGIC "CESWAP1\n"
+// 기록이 빠진 스왑 파일의 머리. 헤더가 맞지 않으므로 재생하지 않는다
+#define BROKEN_MAGIC "CESWAPX\n"
+// 연산 하나의 머리: 종류 1바이트 + 오프셋 8바이트 + 길이 8바이트 (삽입이면 뒤에 내용)
+#define REC_HEAD 17
+
+struct swap_header {
+    char magic[8];
+    uint64_t size;          // 기준 원본 파일 크기 (파일이 없으면 0)
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct journal {
+    int fd;
+    char path[4096];        // 원본 파일
+    char swap[4096];        // 스왑 파일
+    char* buf;              // 아직 쓰지 않은 연산들
+    size_t len, cap;
+    int broken;             // 연산 하나를 담지 못해 더는 기록하지 않는다 (문서 잠금 안에서 바뀜)
+    int sealed;             // journal_take 가 넘겨받은 broken. 잠금 밖의 파일 쓰기는 이것만 본다
+};
+
+void journal_swap_path(const char* path, char* out, size_t n) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    snprintf(out, n, "%.*s.%s.swp", dir_len, path, path + dir_len);
+}
+
+static void make_header(const char* path, struct swap_header* h) {
+    struct stat st;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SWAP_MAGIC, 8);
+    if (stat(path, &st) == 0) {
+        h->size = st.st_size;
+        h->mtime_sec = st.st_mtim.tv_sec;
+        h->mtime_nsec = st.st_mtim.tv_nsec;
+    }
+}
+
+// 스왑 파일 전체를 읽는다. 헤더가 현재 원본과 맞지 않으면 NULL
+static char* load_swap(const char* path, size_t* size) {
+    char swap[4096];
+    struct stat st;
+    struct swap_header now;
+    journal_swap_path(path, swap, sizeof(swap));
+
+    int fd = open(swap, O_RDONLY);
+    if (fd < 0) return NULL;
+    char* data = NULL;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct swap_header)) goto out;
+    data = malloc(st.st_size);
+    if (!data) goto out;
+
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t r = read(fd, data + got, st.st_size - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += r;
+    }
+    make_header(path, &now);
+    if (got < sizeof(now) || memcmp(data, &now, sizeof(now)) != 0) {
+        free(data);
+        data = NULL;
+        goto out;
+    }
+    *size = got;
+out:
+    close(fd);
+    return data;
+}
+
+// 헤더 뒤의 연산들을 훑는다. doc 이 있으면 적용한다.
+// 온전한 마지막 기록의 끝 위치를 돌려주고, *count 에 연산 수를 담는다
+static size_t walk_records(const char* data, size_t size, document* doc, long* count) {
+    size_t pos = sizeof(struct swap_header);
+    *count = 0;
+    while (pos + REC_HEAD <= size) {
+        char op = data[pos];
+        uint64_t off, len;
+        memcpy(&off, data + pos + 1, 8);
+        memcpy(&len, data + pos + 9, 8);
+        size_t body = op == DOC_EDIT_INSERT ? len : 0;
+        if ((op != DOC_EDIT_INSERT && op != DOC_EDIT_DELETE) || body > size - pos - REC_HEAD) break;
+        if (doc) {
+            if (off > doc_length(doc)) break;
+            int r = op == DOC_EDIT_INSERT ? doc_insert(doc, off, data + pos + REC_HEAD, len)
+                                          : doc_delete(doc, off, len);
+            if (r < 0) break;
+        }
+        pos += REC_HEAD + body;
+        (*count)++;
+    }
+    return pos;
+}
+
+int journal_exists(const char* path) {
+    size_t size;
+    long count;
+    char* data = load_swap(path, &size);
+    if (!data) return 0;
+    walk_records(data, size, NULL, &count);
+    free(data);
+    return count > 0;
+}
+
+long journal_replay(const char* path, document* doc) {
+    size_t size;
+    long count;
+    char* data = load_swap(path, &size);
+    if (!data) return -1;
+    walk_records(data, size, doc, &count);
+    free(data);
+    return count;
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// 빠진 기록 뒤로 이어진 연산을 재생하면 문서가 어긋나므로 스왑 파일을 못 쓰게 표시한다
+static int mark_broken(journal* j) {
+    return pwrite(j->fd, BROKEN_MAGIC, 8, 0) == 8 ? 0 : -1;
+}
+
+// 스왑 파일을 현재 원본 기준의 헤더만 남기고 비운다
+static int write_header(journal* j) {
+    struct swap_header h;
+    make_header(j->path, &h);
+    if (ftruncate(j->fd, 0) < 0 || lseek(j->fd, 0, SEEK_SET) < 0) return -1;
+    return write_all(j->fd, (const char*)&h, sizeof(h));
+}
+
+journal* journal_open(const char* path, int keep) {
+    journal* j = calloc(1, sizeof(*j));
+    if (!j) return NULL;
+    snprintf(j->path, sizeof(j->path), "%s", path);
+    journal_swap_path(path, j->swap, sizeof(j->swap));
+
+    j->fd = open(j->swap, O_RDWR | O_CREAT, 0600);
+    if (j->fd < 0) {
+        free(j);
+        return NULL;
+    }
+
+    size_t size, end = 0;
+    long count;
+    char* data = keep ? load_swap(path, &size) : NULL;
+    if (data) {
+        // 끝이 잘린 기록은 잘라 내고 그 뒤에 이어 쓴다
+        end = walk_records(data, size, NULL, &count);
+        free(data);
+    }
+    if (end > 0 ? ftruncate(j->fd, end) < 0 || lseek(j->fd, end, SEEK_SET) < 0
+                : write_header(j) < 0) {
+        journal_close(j, 1);
+        return NULL;
+    }
+    return j;
+}
+
+void journal_record(int op, size_t off, const char* text, size_t len, void* arg) {
+    journal* j = arg;
+    if (j->broken) return;
+    size_t body = op == DOC_EDIT_INSERT ? len : 0;
+    size_t need = j->len + REC_HEAD + body;
+    if (need > j->cap) {
+        size_t cap = j->cap ? j->cap : 4096;
+        while (cap < need) cap *= 2;
+        char* p = realloc(j->buf, cap);
+        if (!p) {
+            // 이 연산을 건너뛰고 이어 쓰면 재생이 어긋난다. 쌓인 것도 버리고 기록을 멈춘다
+            free(j->buf);
+            j->buf = NULL;
+            j->len = j->cap = 0;
+            j->broken = 1;
+            return;
+        }
+        j->buf = p;
+        j->cap = cap;
+    }
+    uint64_t o = off, l = len;
+    char* rec = j->buf + j->len;
+    rec[0] = (char)op;
+    memcpy(rec + 1, &o, 8);
+    memcpy(rec + 9, &l, 8);
+    if (body) memcpy(rec + REC_HEAD, text, body);
+    j->len = need;
+}
+
+size_t journal_pending(journal* j) {
+    return j ? j->len : 0;
+}
+
+size_t journal_take(journal* j, char** buf) {
+    *buf = NULL;
+    if (!j) return 0;
+    j->sealed = j->broken;
+    if (j->len == 0) return 0;
+    size_t len = j->len;
+    *buf = j->buf;
+    j->buf = NULL;
+    j->len = j->cap = 0;
+    return len;
+}
+
+int journal_write(journal* j, char* buf, size_t len) {
+    if (j->sealed) {
+        free(buf);
+        mark_broken(j);
+        return -1;
+    }
+    int r = len > 0 ? write_all(j->fd, buf, len) : 0;
+    free(buf);
+    return r;
+}
+
+int journal_flush(journal* j) {
+    char* buf;
+    size_t len = journal_take(j, &buf);
+    return len > 0 ? journal_write(j, buf, len) : 0;
+}
+
+int journal_reset(journal* j) {
+    if (!j) return 0;
+    if (j->sealed) {
+        mark_broken(j);
+        return -1;
+    }
+    return write_header(j);
+}
+
+void journal_close(journal* j, int remove_swap) {
+    if (!j) return;
+    if (j->broken && !remove_swap) mark_broken(j);
+    close(j->fd);
+    if (remove_swap) unlink(j->swap);
+    free(j->buf);
+    free(j);
+}
@@ -0,0 +1,43 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+
+#include "document.h"
+
+// 스왑 저널 (vim 의 .swp 와 비슷)
+// 편집 연산을 문서 옆의 ".이름.swp" 에 이어 붙여 두고, 비정상 종료 뒤
+// 다시 열 때 원본 파일 위에 그대로 재생해 저장하지 못한 편집을 되살린다.
+// 헤더에는 기준이 되는 원본 파일의 크기/수정 시각을 적어 두어, 파일이 바뀌었으면 재생하지 않는다.
+typedef struct journal journal;
+
+// path 의 스왑 파일 경로를 out 에 만든다
+void journal_swap_path(const char* path, char* out, size_t n);
+
+// path 에 대해 재생할 수 있는 스왑 파일이 있으면 1
+int journal_exists(const char* path);
+
+// 스왑 파일의 연산을 doc 에 적용한다. 끝이 잘린 기록은 버린다. 적용한 연산 수 (실패 시 -1)
+long journal_replay(const char* path, document* doc);
+
+// 저널을 연다. keep 이 0이면 현재 파일 기준으로 새로 만들고, 1이면 기존 기록 뒤에 이어 쓴다
+journal* journal_open(const char* path, int keep);
+
+// 쌓인 연산이 이만큼 넘으면 자동 저장 주기를 기다리지 않고 쓰는 것이 좋다
+#define JOURNAL_FLUSH_AT (256 * 1024)
+
+// doc_set_edit_hook 에 넘기는 콜백. 메모리에만 쌓고 파일에는 쓰지 않는다
+// 메모리가 모자라 연산 하나를 담지 못하면 그 뒤로는 기록하지 않고, 스왑 파일은 재생하지 않도록 표시된다
+// (다음 journal_take 뒤의 journal_write/journal_reset 이 -1 을 돌려주며 표시, 닫을 때도 표시)
+void journal_record(int op, size_t off, const char* text, size_t len, void* arg);
+
+size_t journal_pending(journal* j);     // 아직 파일에 쓰지 않은 바이트 수
+// 쌓인 연산을 떼어 낸다 (문서 잠금 안에서). 떼어 낸 묶음은 journal_write 로 잠금 밖에서 쓴다
+size_t journal_take(journal* j, char** buf);
+int journal_write(journal* j, char* buf, size_t len);  // write 한 번으로 이어 붙이고 buf 를 해제
+int journal_flush(journal* j);          // take + write
+// 저장 직후 호출. 스왑 파일을 저장된 파일 기준 헤더만 남기고 비운다 (쌓인 연산은 그대로)
+int journal_reset(journal* j);
+void journal_close(journal* j, int remove_swap);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+
+// 키워드 분류기. 본체(keywords.c)는 빌드할 때 keywords.txt 에서 만들어진다.
+// 길이와 첫 글자로 분기한 뒤 후보 몇 개만 비교하므로 목록 크기와 무관하다.
+enum {
+    KW_NONE,
+    KW_TYPE,        // 자료형/할당 함수 (시안)
+    KW_KEYWORD,     // 제어문/한정자 (마젠타)
+};
+
+// 언어 (비트 마스크, keywords.txt 의 [언어] 이름과 짝)
+#define KW_LANG_C      1
+#define KW_LANG_CPP    2
+#define KW_LANG_PYTHON 4
+#define KW_LANG_SH     8
+#define KW_LANG_MAKE   16
+
+// word[0, len) 의 분류. lang 언어의 키워드가 아니면 KW_NONE
+int keyword_class(const char* word, size_t len, int lang);
+
+#endif
@@ -0,0 +1,151 @@
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINEINDEX_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define LINEINDEX_NEON 1
+#endif
+
+#include "lineindex.h"
+
+typedef size_t (*scan_fn)(const char*, size_t, size_t, uint32_t*, size_t, size_t*, int*);
+
+// 찾은 개행 하나를 기록한다. out 이 가득 차면 그 자리에서 돌아간다
+#define EMIT(pos)                                           \
+    do {                                                    \
+        size_t at_ = (pos);                                 \
+        if (at_ > 0 && data[at_ - 1] == '\r') *crlf = 1;    \
+        out[n++] = (uint32_t)at_;                           \
+        if (n == cap) {                                     \
+            *stop = at_ + 1;                                \
+            return n;                                       \
+        }                                                   \
+    } while (0)
+
+static size_t scan_scalar(const char* data, size_t from, size_t to,
+                          uint32_t* out, size_t cap, size_t* stop, int* crlf) {
+    size_t n = 0;
+    const char* p = data + from;
+    const char* end = data + to;
+    if (cap == 0) {
+        *stop = from;
+        return 0;
+    }
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        EMIT((size_t)(p - data));
+        p++;
+    }
+    *stop = to;
+    return n;
+}
+
+#ifdef LINEINDEX_X86
+// 비교용으로만 남긴다 (bench_lineindex). 디스패치는 memchr 를 쓴다
+__attribute__((unused))
+static size_t scan_sse2(const char* data, size_t from, size_t to,
+                        uint32_t* out, size_t cap, size_t* stop, int* crlf) {
+    size_t n = 0, i = from;
+    const __m128i nl = _mm_set1_epi8('\n');
+    if (cap == 0) {
+        *stop = from;
+        return 0;
+    }
+    for (; i + 16 <= to; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        while (mask) {
+            EMIT(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < to; i++)
+        if (data[i] == '\n') EMIT(i);
+    *stop = to;
+    return n;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char* data, size_t from, size_t to,
+                        uint32_t* out, size_t cap, size_t* stop, int* crlf) {
+    size_t n = 0, i = from;
+    const __m256i nl = _mm256_set1_epi8('\n');
+    if (cap == 0) {
+        *stop = from;
+        return 0;
+    }
+    // 64바이트씩 두 번 비교해 개행이 없는 구간은 바로 건너뛴다
+    for (; i + 64 <= to; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl)) |
+                        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl)) << 32);
+        while (mask) {
+            EMIT(i + __builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < to; i++)
+        if (data[i] == '\n') EMIT(i);
+    *stop = to;
+    return n;
+}
+#endif
+
+#ifdef LINEINDEX_NEON
+static size_t scan_neon(const char* data, size_t from, size_t to,
+                        uint32_t* out, size_t cap, size_t* stop, int* crlf) {
+    size_t n = 0, i = from;
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    if (cap == 0) {
+        *stop = from;
+        return 0;
+    }
+    for (; i + 16 <= to; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)(data + i)), nl);
+        // 바이트마다 4비트씩 담긴 64비트 마스크로 줄인다 (movemask 대용)
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            EMIT(i + (__builtin_ctzll(mask) >> 2));
+            mask &= ~(0xFULL << (__builtin_ctzll(mask) & ~3));
+        }
+    }
+    for (; i < to; i++)
+        if (data[i] == '\n') EMIT(i);
+    *stop = to;
+    return n;
+}
+#endif
+
+static scan_fn kernel;
+static const char* kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void) {
+    kernel = scan_scalar;
+#if defined(LINEINDEX_X86)
+    __builtin_cpu_init();
+    // SSE2 는 고르지 않는다. glibc 의 memchr 가 이미 벡터화되어 있어 scan_sse2 가 이기지 못한다
+    // (bench_lineindex 에서 -O2 로 같고, 편집기 빌드인 -g 로는 두 배 가까이 느리다)
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = scan_avx2;
+        kernel_name = "avx2";
+    }
+#elif defined(LINEINDEX_NEON)
+    kernel = scan_neon;
+    kernel_name = "neon";
+#endif
+}
+
+size_t line_index_scan(const char* data, size_t from, size_t to,
+                       uint32_t* out, size_t cap, size_t* stop, int* crlf) {
+    pthread_once(&kernel_once, pick_kernel);
+    return kernel(data, from, to, out, cap, stop, crlf);
+}
+
+const char* line_index_kernel(void) {
+    pthread_once(&kernel_once, pick_kernel);
+    return kernel_name;
+}
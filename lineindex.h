@@ -0,0 +1,18 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 개행 색인 커널
+// data[from, to) 에서 '\n' 위치를 찾아 out 에 오름차순으로 기록한다.
+// out 이 cap 개로 다 차면 거기서 멈추고 *stop 에 다음에 이어서 볼 위치를 돌려준다.
+// "\r\n" 을 만나면 *crlf 를 1로 만든다. 반환값은 기록한 개수.
+// CPU에 맞는 구현(AVX2/NEON/memchr)을 처음 호출할 때 고른다.
+size_t line_index_scan(const char* data, size_t from, size_t to,
+                       uint32_t* out, size_t cap, size_t* stop, int* crlf);
+
+// 현재 선택된 구현 이름 (상태 표시용)
+const char* line_index_kernel(void);
+
+#endif
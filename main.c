@@ -9,19 +9,41 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+#include <poll.h>
+
+#include "document.h"
+#include "journal.h"
+#include "highlight.h"
+#include "grammar.h"
+#include "search.h"
+#include "grep.h"
+#include "undo.h"
+#include "clipboard.h"
 
 #define MENU_HEIGHT 1
 #define STATUS_HEIGHT 1
 #define MAX_FILES 256
-#define MAX_ROWS 1500
-#define MAX_COLS 256
+// 입력이 없을 때 한 번에 더 훑는 검색 바이트 수
+#define SEARCH_IDLE_BYTES (4 * 1024 * 1024)
+// 검색어를 입력하는 동안 키 입력 사이에 훑는 바이트 수 (다음 키를 늦게 읽지 않도록 작게)
+#define SEARCH_PROMPT_BYTES (1024 * 1024)
+#define SEARCH_QUERY_MAX 200
+// 터미널이 붙여 넣기 앞뒤에 보내는 ESC[200~ 와 ESC[201~ 를 이 키로 받는다 (define_key)
+#define KEY_PASTE_BEGIN (KEY_MAX + 1)
+#define KEY_PASTE_END (KEY_MAX + 2)
+// 붙여 넣기 중에 입력이 이만큼 끊기면 끝 표시를 못 받았어도 거기까지만 넣는다
+#define PASTE_IDLE_MS 1000
+#define PASTE_CHUNK (64 * 1024)
 
 WINDOW* editor_win;
 
 const char* menu_titles[] = {"File", "Build", "Option", "Help"};
 const char* file_menu[] = {"New", "Open", "Save", "Exit"};
 const char* build_menu[] = {"Run", "Link"};
-const char* option_menu[] = {"NumLine", "Syntax", "Bracket", "AutoSave", "Seconds"};
+const char* option_menu[] = {"NumLine", "Syntax", "Bracket", "AutoSave", "Seconds", "UndoMB"};
 const char* help_menu[] = {"Status", "Guide"};
 char status_message[256] = "";
 
@@ -31,12 +53,24 @@ int hide_brackets = 0;
 int current_menu = -1;
 int current_item = 0;
 int input_enabled = 0;
+int quit_requested = 0;     // 메뉴에서 끝내기를 골랐다. 메인 루프가 보고 빠져나간다
 int autosave_enabled = 0;
 int autosave_tick = 5;
 int scroll_offset = 0; 
 
 int cursor_x = 0, cursor_y = 0;
-char editor_buf[MAX_ROWS][MAX_COLS];
+document* doc;                  // 현재 편집 중인 문서
+char* line_buf = NULL;          // 렌더링/검색에서 재사용하는 줄 버퍼
+size_t line_cap = 0;
+
+journal* swap_journal = NULL;   // 현재 문서의 스왑 저널 (파일 이름이 없으면 NULL)
+highlighter* syntax = NULL;     // 현재 문서의 구문 강조 캐시
+search* finder = NULL;          // 마지막 검색 (Ctrl+F, F3/Shift+F3)
+undo* history = NULL;           // 되돌리기 기록 (Ctrl+Z / Ctrl+Y)
+long current_match = -1;        // 커서가 가 있는 검색 결과 번호
+int search_regex = 0;           // 검색어를 정규식으로 본다 (검색/바꾸기 입력 중에 Alt+R 로 바꾼다)
+char grep_query[SEARCH_QUERY_MAX + 1] = "";     // 마지막으로 여러 파일에서 찾은 말 (Ctrl+G)
+unsigned long saved_version = 0;    // 마지막으로 저장했을 때의 doc_version
 
 char opened_filename[256] = "";
 char link_flags[256] = "";
@@ -48,6 +82,7 @@ void draw_status_bar(const char* message);
 void draw_dropdown(int menu_index);
 
 void render_editor_buffer();
+void invalidate_editor_view();
 
 void handle_key_input(int ch);
 void handle_resize(int sig);
@@ -55,11 +90,11 @@ int handle_menu_input(int ch);
 
 
 int get_filename_from_user(char* out_filename);
-int is_cyan_keyword(const char* word);
-int is_magenta_keyword(const char* word);
 
 void show_editor_logo();
 void show_file_list_popup();
+int open_file(const char* path);
+void find_in_files();
 
 void clear_dropdown(int menu_index);
 
@@ -67,19 +102,28 @@ void run_in_gnome_terminal();
 void tap(int actual_row, int actual_col);
 void countBlock(int actual_row, int actual_col);
 void search_text();
+void replace_text();
+void undo_edit(int redo);
+void find_match(int dir, int here);
+size_t cursor_offset();
+void move_cursor_to(size_t off);
+void show_match_status(long i, int wrapped);
 void save_current_file();
 
-void* saveFileThread(void*);
-void autoSaveHandler();
+void save_file_async();
+void saver_request(int* flag);
+void saver_stop();
+void drain_status();
+void attach_journal(const char* path, int keep);
+void detach_journal(int discard);
+int close_current_file(int* discard);
+void keep_undo_history();
+void set_bracketed_paste(int on);
 
 int get_menu_item_count(int menu_index);
 void show_help_status_popup();
 void show_help_guide_popup();
 
-const char* cyan_keywords[] = {"int", "double", "float", "enum", "char", "short", "long", "malloc", "free", "calloc", "realloc", NULL};
-const char* magenta_keywords[] = {"void", "unsigned", "signed", "sizeof", "typedef", "struct", "union", "extern", "static", "const",
-                                 "if", "else", "switch", "case", "default", "while", "for", "do", "continue", "break", "return", NULL};
-
 
 // copy several lines by input from users
 void copy() {
@@ -118,34 +162,154 @@ void copy() {
     }
     for (int k = 0; k < idx; k++) 
     pageNum = (pageNum * 10) + arr[k];
-   
-    for (int k = scroll_offset + cursor_y; k < scroll_offset + cursor_y + pageNum; k++) {
-        strcpy(copiedStr[copiedNum++], editor_buf[k]);
+
+    if (pageNum == 0) {
+        draw_status_bar("");
+        return;
     }
-    copiedStart = scroll_offset + cursor_y;
 
+    pthread_mutex_lock(&mutex);
+    int start = scroll_offset + cursor_y;
+    int end = start + pageNum;
+    if (end > doc_line_count(doc)) end = doc_line_count(doc);
+    // start 줄의 시작부터 end 줄의 시작(= 마지막 줄의 개행 뒤)까지. 내용은 복사하지 않고 조각만 잡아 둔다
+    size_t from = doc_line_offset(doc, start);
+    size_t to = end < doc_line_count(doc) ? doc_line_offset(doc, end) : doc_length(doc);
+    int r = clipboard_copy(doc, from, to - from);
     pthread_mutex_unlock(&mutex);
+    // tmux/데몬/터미널로 내보내는 동안 다른 스레드가 문서를 기다리지 않게 잠금 밖에서 한다
+    if (r == 0) r = clipboard_publish();
+
+    char msg_done[64];
+    if (r < 0) snprintf(msg_done, sizeof(msg_done), "Copy failed.");
+    else snprintf(msg_done, sizeof(msg_done), "%d line(s) copied%s", end - start, r ? "" : " (this editor only)");
+    draw_status_bar(msg_done);
 }
 
 void paste() {
+    // 공유 클립보드에서 받아 오는 일은 잠금 밖에서 한다. 닿지 못하면 이 편집기에서 복사한 내용을 붙인다
+    clipboard_fetch();
     pthread_mutex_lock(&mutex);
-    strcpy(editor_buf[scroll_offset + cursor_y], copiedStr);
+    // 현재 줄 앞에 클립보드 내용을 끼워 넣는다 (이 편집기에서 복사한 것이면 조각째)
+    size_t off = doc_line_offset(doc, scroll_offset + cursor_y);
+    size_t len = 0;
+    char last = '\n';
+    undo_begin(history);
+    int r = clipboard_paste(doc, off, &len);
+    if (len > 0) doc_read(doc, off + len - 1, &last, 1);
+    if (last != '\n')
+        doc_insert(doc, off + len, doc_eol(doc), strlen(doc_eol(doc)));
+    undo_end(history);
+    pthread_mutex_unlock(&mutex);
 
-    for (int k = MAX_ROWS - 1; k > copiedNum + cursor_y + scroll_offset; k--) {
-        strcpy(editor_buf[k], editor_buf[k-copiedNum]);
-    }
+    render_editor_buffer();
+    if (r < 0) draw_status_bar("Paste failed.");
+    else draw_status_bar(len > 0 ? "Pasted" : "Clipboard is empty.");
+}
 
-    int j = 0;
-    for (int k = scroll_offset + cursor_y;  k < scroll_offset + cursor_y + copiedNum; k++) {
-        strcpy(editor_buf[k], copiedStr[j++]);
+// 터미널이 붙여 넣기를 감싸 보내게(bracketed paste) 하거나 그만두게 한다.
+// 한 줄 입력창(wgetnstr)은 표시를 글자로 받아 버리므로 그동안은 끈다
+void set_bracketed_paste(int on) {
+    printf(on ? "\033[?2004h" : "\033[?2004l");
+    fflush(stdout);
+}
+
+// 터미널에서 붙여 넣은 바이트를 모으는 버퍼
+struct paste_buf {
+    char* data;
+    size_t len, cap;
+    const char* eol;            // 문서의 줄 끝
+    size_t eol_len;
+    int prev_cr, failed;
+};
+
+// 바이트 하나를 모은다. 터미널은 줄 끝을 '\r' 로 보내므로 '\r', '\n', "\r\n" 을 문서의 줄 끝 하나로 바꾼다
+void paste_byte(struct paste_buf* pb, char c) {
+    const char* add = &c;
+    size_t n = 1;
+    if (c == '\n' && pb->prev_cr) {
+        n = 0;
+    } else if (c == '\r' || c == '\n') {
+        add = pb->eol;
+        n = pb->eol_len;
     }
-    memset(copiedStr, 0, sizeof(copiedStr));
+    pb->prev_cr = c == '\r';
+    if (pb->failed) return;
+    if (pb->len + n > pb->cap) {
+        size_t cap = pb->cap ? pb->cap * 2 : 64 * 1024;
+        char* p = realloc(pb->data, cap);
+        if (!p) {
+            pb->failed = 1;
+            return;
+        }
+        pb->data = p;
+        pb->cap = cap;
+    }
+    memcpy(pb->data + pb->len, add, n);
+    pb->len += n;
+}
 
+// 터미널에서 붙여 넣은 내용 (ESC[200~ ... ESC[201~). 키 입력 처리(자동 들여쓰기, 괄호 짝 맞추기, 키마다 다시 그리기)를
+// 거치지 않고 바이트를 모아 커서 자리에 한 번에 넣은 뒤 한 번만 그린다.
+// getch 는 바이트마다 read 를 부르므로 (1 MB 에 몇 초) 표준 입력에서 직접 크게 읽는다.
+// 시작 표시가 키 하나로 끝까지 맞춰진 뒤라 ncurses 가 앞서 읽어 둔 바이트는 없다
+void bracketed_paste() {
+    static const char end_mark[] = "\033[201~";
+    struct paste_buf pb = { 0 };
+    pthread_mutex_lock(&mutex);
+    pb.eol = doc_eol(doc);
     pthread_mutex_unlock(&mutex);
-    copiedNum = 0;Add commentMore actions
-    copiedStart = 0;
+    pb.eol_len = strlen(pb.eol);
+
+    char* chunk = malloc(PASTE_CHUNK);
+    size_t matched = 0;
+    int ended = 0;
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    while (chunk && !ended && poll(&pfd, 1, PASTE_IDLE_MS) > 0) {
+        ssize_t n = read(STDIN_FILENO, chunk, PASTE_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) {
+            char c = chunk[i];
+            if (ended) {
+                // 끝 표시 뒤에 같이 온 키 입력은 ncurses 로 돌려준다 (뒤에서부터 넣어야 순서가 맞다)
+                for (ssize_t j = n - 1; j >= i; j--) ungetch((unsigned char)chunk[j]);
+                break;
+            }
+            if (c == end_mark[matched]) {
+                if (++matched == sizeof(end_mark) - 1) ended = 1;
+                continue;
+            }
+            // 끝 표시가 아니었으면 맞춰 본 앞부분도 내용이다
+            for (size_t k = 0; k < matched; k++) paste_byte(&pb, end_mark[k]);
+            matched = c == end_mark[0];
+            if (!matched) paste_byte(&pb, c);
+        }
+    }
+    if (!ended)
+        for (size_t k = 0; k < matched; k++) paste_byte(&pb, end_mark[k]);
+    if (!chunk) pb.failed = 1;
+    free(chunk);
 
-    render_editor_buffer();
+    if (!input_enabled) {
+        free(pb.data);
+        return;
+    }
+    int r = -1;
+    if (!pb.failed) {
+        pthread_mutex_lock(&mutex);
+        size_t off = cursor_offset();
+        undo_begin(history);
+        r = doc_insert(doc, off, pb.data, pb.len);
+        undo_end(history);
+        if (r == 0) move_cursor_to(off + pb.len);
+        pthread_mutex_unlock(&mutex);
+        render_editor_buffer();
+    }
+    free(pb.data);
+    if (r < 0) draw_status_bar("Paste failed (out of memory).");
+    else if (!ended) draw_status_bar("Pasted (end of paste not received).");
+    else draw_status_bar("Pasted");
 }
 
 void show_help_guide_popup() {
@@ -156,6 +320,12 @@ void show_help_guide_popup() {
         "F5             : Compile and run (gcc)",
         "Alt+S          : Save file",
         "Ctrl+F         : Find text",
+        "F3 / Shift+F3  : Next / previous match",
+        "Ctrl+R         : Replace all",
+        "Ctrl+G         : Find in files",
+        "Ctrl+Z / Ctrl+Y: Undo / redo",
+        "Ctrl+K / Ctrl+V: Copy lines / paste",
+        "Alt+R          : Regex on/off (while typing a query)",
         "",
         "Arrow Keys     : Move cursor",
         "Enter          : Insert newline",
@@ -206,11 +376,12 @@ void show_help_guide_popup() {
     delwin(win);
     touchwin(stdscr);
     refresh();
+    invalidate_editor_view();
     render_editor_buffer();
 }
 
 void show_help_status_popup() {
-    int win_h = 10, win_w = 50;
+    int win_h = 11, win_w = 50;
     int start_y = (LINES - win_h) / 2;
     int start_x = (COLS - win_w) / 2;
     WINDOW* popup = newwin(win_h, win_w, start_y, start_x);
@@ -222,8 +393,12 @@ void show_help_status_popup() {
     mvwprintw(popup, 4, 4, "Bracket Visibility   : %s", hide_brackets ? "Hidden" : "Shown");
     mvwprintw(popup, 5, 4, "AutoSave             : %s", autosave_enabled ? "ON" : "OFF");
     mvwprintw(popup, 6, 4, "AutoSave Interval    : %d sec", autosave_tick);
+    pthread_mutex_lock(&mutex);
+    size_t undo_used = undo_bytes(history), undo_limit = undo_budget(history);
+    pthread_mutex_unlock(&mutex);
+    mvwprintw(popup, 7, 4, "Undo History         : %zu KB / %zu MB", undo_used / 1024, undo_limit / (1024 * 1024));
 
-    mvwprintw(popup, 8, 2, "Press ESC to close...");
+    mvwprintw(popup, 9, 2, "Press ESC to close...");
     wrefresh(popup);
 
     keypad(popup, TRUE);
@@ -232,43 +407,186 @@ void show_help_status_popup() {
     delwin(popup);
     touchwin(stdscr);
     refresh();
+    invalidate_editor_view();
     render_editor_buffer();
 }
 
 int get_menu_item_count(int menu_index) {
     if (menu_index == 0) return 4;
     if (menu_index == 1) return 2;
-    if (menu_index == 2) return 5; // NUM, SYN, Bracket, AutoSave, Seconds
+    if (menu_index == 2) return 6; // NUM, SYN, Bracket, AutoSave, Seconds, UndoMB
     if (menu_index == 3) return 2;
     return 0;
 }
 
-void autoSaveHandler() {
-    if (!autosave_enabled) return;
-    pthread_t t;
+// 저장 스레드가 잠금 밖에서 디스크에 쓰는 동안 잡는다.
+// 문서/저널을 바꿔 끼우는 쪽도 잡아서 쓰는 도중에 저널이 닫히지 않게 한다 (io_mutex → mutex 순서)
+pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 저장 스레드에 보내는 요청. saver_lock 으로 보호
+pthread_t saver;
+pthread_mutex_t saver_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t saver_cond = PTHREAD_COND_INITIALIZER;
+int saver_save = 0;     // 파일 저장
+int saver_flush = 0;    // 저널 쓰기
+int saver_rearm = 0;    // 자동 저장 설정이 바뀜
+int saver_quit = 0;
+
+// 다른 스레드가 남긴 상태 메시지. 메인 루프만 화면에 그린다
+#define STATUS_QUEUE 8
+char status_queue[STATUS_QUEUE][128];
+int status_head = 0, status_count = 0;
+pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void post_status(const char* message) {
+    pthread_mutex_lock(&status_lock);
+    if (status_count == STATUS_QUEUE) {     // 가득 차면 가장 오래된 것을 버린다
+        status_head = (status_head + 1) % STATUS_QUEUE;
+        status_count--;
+    }
+    snprintf(status_queue[(status_head + status_count) % STATUS_QUEUE], sizeof(status_queue[0]), "%s", message);
+    status_count++;
+    pthread_mutex_unlock(&status_lock);
+}
 
-    if (pthread_create(&t, NULL, saveFileThread, NULL) != 0) 
-        perror("can't creat thread for autosave");
-    else
-        pthread_detach(t);
+void drain_status() {
+    char message[128];
+    int shown = 0;
+    pthread_mutex_lock(&status_lock);
+    while (status_count > 0) {
+        memcpy(message, status_queue[status_head], sizeof(message));
+        status_head = (status_head + 1) % STATUS_QUEUE;
+        status_count--;
+        shown = 1;
+    }
+    pthread_mutex_unlock(&status_lock);
+    if (!shown) return;
+    draw_status_bar(message);
+    wmove(editor_win, cursor_y + 1, cursor_x + 1);
+    wrefresh(editor_win);
+}
+
+void saver_request(int* flag) {
+    pthread_mutex_lock(&saver_lock);
+    *flag = 1;
+    pthread_cond_signal(&saver_cond);
+    pthread_mutex_unlock(&saver_lock);
+}
 
-    alarm(5);
+// 자동 저장: 마지막으로 쓴 뒤의 편집만 스왑 저널에 붙인다. 바뀐 것이 없으면 아무것도 하지 않음
+void flush_journal_in_background() {
+    char* batch;
+    pthread_mutex_lock(&io_mutex);
+    pthread_mutex_lock(&mutex);
+    journal* j = swap_journal;
+    size_t len = journal_take(j, &batch);
+    pthread_mutex_unlock(&mutex);
+    if (len > 0) post_status(journal_write(j, batch, len) < 0 ? "Failed to write swap file." : "Autosaved.");
+    pthread_mutex_unlock(&io_mutex);
 }
 
-void* saveFileThread(void *arg) {
+// 잠금 안에서는 스냅숏만 뜨고, 파일 쓰기/fsync/rename 은 잠금 밖에서 한다
+void save_in_background() {
+    char path[256], *batch;
+    pthread_mutex_lock(&io_mutex);
     pthread_mutex_lock(&mutex);
-    const char* filename = opened_filename;
-    FILE* fp = fopen(filename, "w");
-    if (!fp) {
-        draw_status_bar("Failed to save file.");
-        return NULL;
+    snprintf(path, sizeof(path), "%s", (strlen(opened_filename) > 0) ? opened_filename : "untitled.txt");
+    journal* j = (strlen(opened_filename) > 0) ? swap_journal : NULL;
+    document* snapshot = doc_snapshot(doc);
+    unsigned long version = doc_version(doc);
+    size_t len = journal_take(j, &batch);
+    pthread_mutex_unlock(&mutex);
+
+    // 저장이 실패해도 저널만으로 되살릴 수 있도록 사본까지의 편집을 먼저 저널에 쓴다
+    if (len > 0) journal_write(j, batch, len);
+    int ok = snapshot && doc_save(snapshot, path) == 0;
+    doc_free(snapshot);
+    if (ok) {
+        journal_reset(j);   // 사본 이후의 편집은 아직 메모리에 있고 새 파일 기준으로 이어진다
+        pthread_mutex_lock(&mutex);
+        saved_version = version;
+        pthread_mutex_unlock(&mutex);
     }
-    for (int i = 0; i < MAX_ROWS; i++) {
-        fprintf(fp, "%s\n", editor_buf[i]);
+    pthread_mutex_unlock(&io_mutex);
+    post_status(ok ? "Saved to file." : "Failed to save file.");
+}
+
+void deadline_after(struct timespec* ts, int seconds) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += seconds;
+}
+
+// 하나뿐인 저장 스레드. 자동 저장 주기마다, 또는 요청이 올 때마다 깨어난다
+void* saver_main(void* arg) {
+    struct timespec deadline;
+    pthread_mutex_lock(&saver_lock);
+    deadline_after(&deadline, autosave_tick);
+    while (!saver_quit) {
+        if (saver_rearm) {
+            saver_rearm = 0;
+            deadline_after(&deadline, autosave_tick);
+        }
+        if (!saver_save && !saver_flush) {
+            if (pthread_cond_timedwait(&saver_cond, &saver_lock, &deadline) == ETIMEDOUT) {
+                if (autosave_enabled) saver_flush = 1;
+                deadline_after(&deadline, autosave_tick);
+            }
+            continue;
+        }
+        int save = saver_save;
+        saver_save = saver_flush = 0;
+        pthread_mutex_unlock(&saver_lock);
+        if (save) save_in_background();     // 저장하면서 저널도 함께 비운다
+        else flush_journal_in_background();
+        pthread_mutex_lock(&saver_lock);
     }
-    fclose(fp);
-    draw_status_bar("Autosaved.");
-    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&saver_lock);
+    return NULL;
+}
+
+void saver_stop() {
+    saver_request(&saver_quit);
+    pthread_join(saver, NULL);
+}
+
+// 편집 알림. 스왑 저널과 되돌리기 기록에 남기고 구문 강조 캐시에서 바뀐 줄들을 무효화한다
+void on_document_edit(int op, size_t off, const char* text, size_t len, void* arg) {
+    document* edited = arg;
+    if (swap_journal) journal_record(op, off, text, len, swap_journal);
+    undo_record(history, op, off, text, len);
+
+    long lines = 0;
+    for (const char* p = text; (p = memchr(p, '\n', text + len - p)) != NULL; p++) lines++;
+    long line = doc_line_at(edited, off);
+    if (op == DOC_EDIT_INSERT) highlight_edit(syntax, line, 0, lines);
+    else highlight_edit(syntax, line, lines, 0);
+}
+
+// 지금 문서의 되돌리기 기록을 파일 옆에 남긴다 (다른 문서로 바꾸거나 끝내기 전에. mutex 를 쥐고 부를 것)
+void keep_undo_history() {
+    if (opened_filename[0]) undo_save(history, opened_filename, doc);
+}
+
+// 지금 문서의 저널을 닫는다. 저장했거나 버리기로 한 편집이면 스왑 파일을 지우고,
+// 아니면 쌓인 연산까지 써서 다음에 열 때 되살릴 수 있게 남긴다 (문서를 놓기 전에 두 잠금을 쥐고 부를 것)
+void detach_journal(int discard) {
+    int drop = discard || doc_version(doc) == saved_version;
+    if (!drop) journal_flush(swap_journal);
+    journal_close(swap_journal, drop);
+    swap_journal = NULL;
+}
+
+// 새로 연 문서에 스왑 저널과 편집 알림을 붙이고 지난번 되돌리기 기록을 불러온다 (이전 저널은 detach_journal 로 닫아 둘 것)
+void attach_journal(const char* path, int keep) {
+    swap_journal = path ? journal_open(path, keep) : NULL;
+    highlight_reset(syntax, doc, grammar_for_path(path));
+    search_clear(finder);
+    undo_clear(history);
+    if (path) undo_load(history, path, doc);
+    current_match = -1;
+    invalidate_editor_view();
+    doc_set_edit_hook(doc, on_document_edit, doc);
+    saved_version = 0;
 }
 
 int get_user_input(const char* prompt, char* out) {
@@ -283,61 +601,434 @@ int get_user_input(const char* prompt, char* out) {
 
     echo();
     curs_set(1);
+    set_bracketed_paste(0);
     mvwgetnstr(win, 2, 2, out, 255);
+    set_bracketed_paste(1);
     noecho();
     curs_set(0);
 
     delwin(win);
     touchwin(stdscr);
     refresh();
+    invalidate_editor_view();
     return strlen(out) > 0;
 }
 
-void search_text() {
-    char query[256] = "";
-    int width = 40;
-    int height = 5;
-    int start_y = (LINES - height) / 2;
-    int start_x = (COLS - width) / 2;
+// 이미 훑은 곳만으로 origin 다음 결과를 정할 수 있으면 커서를 그리로 옮긴다. 아직 모르면 0
+int jump_from(size_t origin) {
+    long i = search_find(finder, origin);
+    if (i == search_count(finder)) {
+        if (!search_done(finder)) return 0;
+        i = search_count(finder) > 0 ? 0 : -1;     // 뒤에 없으면 처음으로
+    }
+    if (i >= 0) {
+        pthread_mutex_lock(&mutex);
+        move_cursor_to(search_match(finder, i));
+        pthread_mutex_unlock(&mutex);
+    }
+    current_match = i;
+    return 1;
+}
 
-    WINDOW* input_win = newwin(height, width, start_y, start_x);
-    box(input_win, 0, 0);
-    mvwprintw(input_win, 1, 2, "Search for:");
-    wrefresh(input_win);
+// 검색어 query 로 finder 를 다시 맞춘다 (mutex 를 쥐고 부를 것). refine 이면 앞 결과에서 좁힐 수 있다.
+// 실패하면 검색을 끄고, 정규식이 틀린 것이면 err 에 까닭을 담는다
+int set_search(const char* query, size_t len, int refine, char* err, size_t errlen) {
+    err[0] = '\0';
+    int rc = -1;
+    if (len > 0 && search_regex) {
+        pattern* p = pattern_get(query, 0, err, errlen);
+        if (p) rc = search_start_pattern(finder, doc, p);
+        pattern_release(p);
+    } else if (len > 0) {
+        rc = refine ? search_refine(finder, doc, query, len) : search_start(finder, doc, query, len);
+    }
+    if (rc < 0) search_clear(finder);
+    return rc;
+}
 
-    echo();
-    curs_set(1);
-    mvwgetnstr(input_win, 2, 2, query, 255);
-    noecho();
-    curs_set(0);
+// Esc 다음에 곧바로 r 이 오면 Alt+R 이다
+int read_alt_r() {
+    timeout(50);
+    int next = getch();
+    if (next == 'r' || next == 'R') return 1;
+    if (next != ERR) ungetch(next);
+    return 0;
+}
 
-    delwin(input_win);
-    touchwin(stdscr);
+// 검색어를 받는 상태 표시줄. 찾은 수(아직 훑는 중이면 +)나 정규식 오류를 함께 보인다
+void draw_search_prompt(const char* query, const char* err) {
+    char msg[256];
+    const char* label = search_regex ? "Regex search: " : "Search: ";
+    int n = snprintf(msg, sizeof(msg), "%s%s", label, query);
+    if (err[0]) {
+        snprintf(msg + n, sizeof(msg) - n, "   [%s]", err);
+    } else if (search_active(finder)) {
+        if (current_match >= 0)
+            snprintf(msg + n, sizeof(msg) - n, "   [%ld of %ld%s]", current_match + 1, search_count(finder),
+                     search_done(finder) ? "" : "+");
+        else
+            snprintf(msg + n, sizeof(msg) - n, "   [%ld%s]", search_count(finder), search_done(finder) ? "" : "+");
+    }
+    draw_status_bar(msg);
+    move(getmaxy(stdscr) - 1, 1 + strlen(label) + strlen(query));
+    curs_set(1);
     refresh();
+}
 
-    if (strlen(query) == 0) {
-        draw_status_bar("Search cancelled.");
+// Ctrl+F. 상태 표시줄에서 검색어를 받으며 글자마다 바로 찾고 화면의 결과를 칠한다.
+// 글자를 붙이면 앞 결과만 다시 확인하고(search_refine), 나머지를 훑는 일은 키 입력이 없는 틈에만
+// 조금씩 하므로 큰 파일에서도 타자가 밀리지 않는다. Enter 는 찾은 자리에 머물고 Esc 는 원래 자리로 돌아간다.
+// Alt+R 은 정규식 검색을 켜고 끈다 (정규식은 글자마다 처음부터 다시 찾는다)
+void search_text() {
+    char query[SEARCH_QUERY_MAX + 1] = "";
+    char err[128] = "";
+    size_t len = 0;
+    int top = scroll_offset, y = cursor_y, x = cursor_x;
+    pthread_mutex_lock(&mutex);
+    size_t origin = cursor_offset();
+    pthread_mutex_unlock(&mutex);
+    int decided = 1;        // 지금 검색어로 커서 자리가 정해졌음
+
+    search_clear(finder);
+    current_match = -1;
+    render_editor_buffer();
+    draw_search_prompt(query, err);
+    for (;;) {
+        timeout(search_done(finder) ? -1 : 0);
+        int ch = getch();
+        if (ch == 27 && read_alt_r()) {
+            search_regex = !search_regex;
+            ch = 0;
+        }
+        if (ch == ERR) {
+            search_step(finder, SEARCH_PROMPT_BYTES);
+        } else if (ch == 27) {
+            scroll_offset = top;
+            cursor_y = y;
+            cursor_x = x;
+            search_clear(finder);
+            current_match = -1;
+            render_editor_buffer();
+            draw_status_bar("Search cancelled.");
+            return;
+        } else if (ch == '\n' || ch == KEY_ENTER) {
+            break;
+        } else {
+            if (ch == 0) {
+                // 정규식을 켜고 껐으면 같은 검색어로 다시 찾는다
+            } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+                if (len == 0) continue;
+                query[--len] = '\0';
+            } else if (ch >= 32 && ch <= 126 && len < SEARCH_QUERY_MAX) {
+                query[len++] = ch;
+                query[len] = '\0';
+            } else {
+                continue;
+            }
+            // 검색어가 바뀌면 원래 자리에서 다시 찾는다
+            scroll_offset = top;
+            cursor_y = y;
+            cursor_x = x;
+            current_match = -1;
+            pthread_mutex_lock(&mutex);
+            set_search(query, len, ch != 0, err, sizeof(err));
+            pthread_mutex_unlock(&mutex);
+            decided = !search_active(finder);
+            if (!decided) decided = jump_from(origin);
+            render_editor_buffer();
+            draw_search_prompt(query, err);
+            continue;
+        }
+        if (!decided && jump_from(origin)) {
+            decided = 1;
+            render_editor_buffer();
+        }
+        draw_search_prompt(query, err);
+    }
+
+    if (!search_active(finder)) {
+        draw_status_bar(err[0] ? "Bad regular expression." : "Search cancelled.");
+        return;
+    }
+    if (!decided) {
+        // 아직 훑는 중이면 결과가 나올 때까지 마저 찾는다
+        find_match(1, 1);
+        return;
+    }
+    if (current_match < 0) {
+        draw_status_bar("No match found.");
         return;
     }
+    pthread_mutex_lock(&mutex);
+    size_t at = cursor_offset();
+    pthread_mutex_unlock(&mutex);
+    show_match_status(current_match, at < origin);
+}
 
-    // 검색 수행
-    for (int i = 0; i < MAX_ROWS; i++) {
-        char* pos = strstr(editor_buf[i], query);
-        if (pos) {
-            int col = pos - editor_buf[i];
-            cursor_y = 0;
-            scroll_offset = i;
-            cursor_x = col;
-            render_editor_buffer();
+// 상태 표시줄에서 한 줄을 buf 에 받는다 (처음 내용은 buf). Enter 면 1, Esc 면 0.
+// regex 가 NULL 이 아니면 Alt+R 로 *regex 를 바꿀 수 있다
+int read_status_line(const char* label, char* buf, size_t cap, int* regex) {
+    size_t len = strlen(buf);
+    int ok = 0;
+    for (;;) {
+        char msg[256];
+        int n = snprintf(msg, sizeof(msg), "%s%s: %s", label, regex && *regex ? " regex" : "", buf);
+        draw_status_bar(msg);
+        move(getmaxy(stdscr) - 1, 1 + (n < (int)sizeof(msg) ? n : (int)sizeof(msg) - 1));
+        curs_set(1);
+        refresh();
+
+        timeout(-1);
+        int ch = getch();
+        if (ch == 27 && read_alt_r()) {
+            if (regex) *regex = !*regex;
+        } else if (ch == 27) {
+            break;
+        } else if (ch == '\n' || ch == KEY_ENTER) {
+            ok = 1;
+            break;
+        } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+            if (len > 0) buf[--len] = '\0';
+        } else if (ch >= 32 && ch <= 126 && len + 1 < cap) {
+            buf[len++] = ch;
+            buf[len] = '\0';
+        }
+    }
+    curs_set(0);
+    return ok;
+}
+
+// Ctrl+R. 찾을 말과 바꿀 말을 받아 문서 전체의 결과를 한꺼번에 바꾼다.
+// 바꾼 내용은 편집 한 번으로 들어가므로 저널, 구문 강조, 화면도 한 번씩만 고친다
+void replace_text() {
+    char query[SEARCH_QUERY_MAX + 1] = "";
+    char with[SEARCH_QUERY_MAX + 1] = "";
+    if (search_active(finder)) snprintf(query, sizeof(query), "%s", search_query(finder));
+    if (!read_status_line("Replace", query, sizeof(query), &search_regex) || !query[0] ||
+        !read_status_line("With", with, sizeof(with), NULL)) {
+        draw_status_bar("Replace cancelled.");
+        return;
+    }
+
+    char err[128];
+    long n = -1;
+    pthread_mutex_lock(&mutex);
+    if (set_search(query, strlen(query), 0, err, sizeof(err)) == 0) {
+        undo_begin(history);
+        n = search_replace_all(finder, doc, with, strlen(with));
+        undo_end(history);
+    }
+    // 줄이 줄었으면 커서를 문서 끝으로
+    if (n > 0 && !doc_line_exists(doc, cursor_y + scroll_offset)) move_cursor_to(doc_length(doc));
+    pthread_mutex_unlock(&mutex);
+    current_match = -1;
+    render_editor_buffer();
+
+    char msg[256];
+    if (err[0]) snprintf(msg, sizeof(msg), "Bad regular expression: %s", err);
+    else if (n < 0) snprintf(msg, sizeof(msg), "Replace failed.");
+    else if (n == 0) snprintf(msg, sizeof(msg), "No match found.");
+    else snprintf(msg, sizeof(msg), "Replaced %ld occurrence%s.", n, n == 1 ? "" : "s");
+    draw_status_bar(msg);
+}
 
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Found at line %d, column %d", i + 1, col + 1);
+// 여러 파일에서 찾은 결과 목록을 그린다
+void draw_grep_popup(WINDOW* popup, grep* g, const char* re_label, long highlight, long offset) {
+    int win_h = getmaxy(popup), win_w = getmaxx(popup);
+    int width = win_w - 4;
+    long count = grep_count(g);
+    char line[512];
+
+    werase(popup);
+    box(popup, 0, 0);
+    snprintf(line, sizeof(line), "Find in files%s: %s", re_label, grep_query);
+    mvwprintw(popup, 1, 2, "%.*s", width, line);
+    for (int i = 0; i < win_h - 4; i++) {
+        struct grep_hit h;
+        if (grep_hit(g, offset + i, &h) < 0) break;
+        snprintf(line, sizeof(line), "%s:%ld:%ld: %s", h.path, h.line + 1, h.col + 1, h.preview);
+        if (offset + i == highlight) wattron(popup, A_REVERSE);
+        mvwprintw(popup, i + 2, 2, "%-*.*s", width, width, line);
+        wattroff(popup, A_REVERSE);
+    }
+    if (!grep_done(g))
+        snprintf(line, sizeof(line), "%ld hit%s in %ld files (searching...)", count, count == 1 ? "" : "s", grep_files(g));
+    else if (count == 0)
+        snprintf(line, sizeof(line), "No match found in %ld files.", grep_files(g));
+    else
+        snprintf(line, sizeof(line), "%ld hit%s in %ld files%s", count, count == 1 ? "" : "s", grep_files(g),
+                 grep_truncated(g) ? " (stopped here)" : "");
+    mvwprintw(popup, win_h - 2, 2, "%.*s", width, line);
+    wrefresh(popup);
+}
+
+// Ctrl+G. 작업 디렉터리 아래 모든 파일에서 찾아 결과를 목록으로 보여 주고, 고른 결과를 그 줄과 칸에 연다.
+// 찾는 동안에도 결과가 늘어나는 대로 목록을 다시 그린다
+void find_in_files() {
+    if (!read_status_line("Find in files", grep_query, sizeof(grep_query), &search_regex) || !grep_query[0]) {
+        draw_status_bar("Find in files cancelled.");
+        return;
+    }
+    char msg[256];
+    pattern* re = NULL;
+    if (search_regex) {
+        char err[128];
+        re = pattern_get(grep_query, 0, err, sizeof(err));
+        if (!re) {
+            snprintf(msg, sizeof(msg), "Bad regular expression: %s", err);
             draw_status_bar(msg);
             return;
         }
     }
+    grep* g = grep_start(".", grep_query, strlen(grep_query), re);
+    pattern_release(re);
+    if (!g) {
+        draw_status_bar("Find in files failed.");
+        return;
+    }
+
+    WINDOW* popup = newwin(getmaxy(stdscr) - 4, getmaxx(stdscr) - 4, 2, 2);
+    keypad(popup, TRUE);
+    int rows = getmaxy(popup) - 4;  // 제목 줄과 개수 줄, 테두리를 뺀 줄 수
+    long highlight = 0, offset = 0;
+    char* chosen = NULL;
+    long line = 0, col = 0;
+
+    while (1) {
+        draw_grep_popup(popup, g, re ? " (regex)" : "", highlight, offset);
+        // 찾는 중이면 결과가 늘어난 것을 보여 주려고 잠깐씩만 기다린다
+        wtimeout(popup, grep_done(g) ? -1 : 100);
+        int ch = wgetch(popup);
+        long count = grep_count(g);
+        if (ch == KEY_UP) highlight--;
+        else if (ch == KEY_DOWN) highlight++;
+        else if (ch == KEY_PPAGE) highlight -= rows;
+        else if (ch == KEY_NPAGE) highlight += rows;
+        else if (ch == KEY_HOME) highlight = 0;
+        else if (ch == KEY_END) highlight = count - 1;
+        else if (ch == 10 || ch == KEY_ENTER) {
+            struct grep_hit h;
+            if (grep_hit(g, highlight, &h) < 0) continue;
+            chosen = strdup(h.path);
+            line = h.line;
+            col = h.col;
+            break;
+        } else if (ch == 27) {
+            break;
+        }
+        if (highlight >= count) highlight = count - 1;
+        if (highlight < 0) highlight = 0;
+        if (highlight < offset) offset = highlight;
+        if (highlight >= offset + rows) offset = highlight - rows + 1;
+    }
+
+    grep_free(g);
+    delwin(popup);
+    touchwin(stdscr);
+    refresh();
+    invalidate_editor_view();
+    box(editor_win, 0, 0);
+    wrefresh(editor_win);
+    if (!chosen) {
+        render_editor_buffer();
+        draw_status_bar("");
+        return;
+    }
+
+    if (strcmp(chosen, opened_filename) != 0 && !open_file(chosen)) {
+        render_editor_buffer();
+    } else {
+        pthread_mutex_lock(&mutex);
+        if (doc_line_exists(doc, line)) {
+            size_t len = doc_line_length(doc, line);
+            move_cursor_to(doc_line_offset(doc, line) + ((size_t)col < len ? (size_t)col : len));
+        }
+        pthread_mutex_unlock(&mutex);
+        render_editor_buffer();
+        snprintf(msg, sizeof(msg), "%s:%ld:%ld", chosen, line + 1, col + 1);
+        draw_status_bar(msg);
+    }
+    free(chosen);
+}
 
-    draw_status_bar("No match found.");
+// Ctrl+Z / Ctrl+Y. 한 단계를 되돌리거나 다시 하고 커서를 고친 자리로 옮긴다
+void undo_edit(int redo) {
+    if (!input_enabled) return;
+    size_t at = 0;
+    pthread_mutex_lock(&mutex);
+    int rc = redo ? undo_redo(history, doc, &at) : undo_undo(history, doc, &at);
+    if (rc != 0) move_cursor_to(at);
+    pthread_mutex_unlock(&mutex);
+    if (rc != 0) render_editor_buffer();
+    if (rc < 0) draw_status_bar(redo ? "Redo failed (out of memory)." : "Undo failed (out of memory).");
+    else if (rc == 0) draw_status_bar(redo ? "Nothing to redo." : "Nothing to undo.");
+    else draw_status_bar(redo ? "Redo" : "Undo");
+}
+
+// 커서가 가리키는 문서 위치 (mutex 를 쥐고 부를 것)
+size_t cursor_offset() {
+    int row = cursor_y + scroll_offset;
+    int col = cursor_x - (show_line_numbers ? 4 : 0);
+    size_t len = doc_line_length(doc, row);
+    if (col < 0) col = 0;
+    if ((size_t)col > len) col = len;
+    return doc_line_offset(doc, row) + col;
+}
+
+// off 위치로 커서를 옮긴다. 이미 화면에 보이는 줄이면 스크롤하지 않는다 (mutex 를 쥐고 부를 것)
+void move_cursor_to(size_t off) {
+    int rows = getmaxy(editor_win) - 2;
+    long line = doc_line_at(doc, off);
+    size_t col = off - doc_line_offset(doc, line);
+    if (line < scroll_offset || line >= scroll_offset + rows) scroll_offset = line;
+    cursor_y = line - scroll_offset;
+    cursor_x = col + (show_line_numbers ? 4 : 0);
+}
+
+// 아직 훑는 중이면 개수 뒤에 + 를 붙인다
+void show_match_status(long i, int wrapped) {
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Match %ld of %ld%s%s", i + 1, search_count(finder),
+             search_done(finder) ? "" : "+", wrapped ? " (wrapped)" : "");
+    draw_status_bar(msg);
+}
+
+// 다음(dir > 0) 또는 이전 결과로 커서를 옮긴다. here 면 커서 자리의 결과도 다음 결과로 친다
+void find_match(int dir, int here) {
+    if (!search_active(finder)) {
+        draw_status_bar("Nothing to find. Press Ctrl+F.");
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    // 검색한 뒤로 문서가 바뀌었으면 같은 검색어로 다시 찾는다
+    if (search_version(finder) != doc_version(doc)) {
+        char query[256];
+        snprintf(query, sizeof(query), "%s", search_query(finder));
+        if (search_is_pattern(finder)) search_start_pattern(finder, doc, search_pattern(finder));
+        else search_start(finder, doc, query, strlen(query));
+    }
+    size_t at = cursor_offset();
+    pthread_mutex_unlock(&mutex);
+
+    long i = dir > 0 ? search_next(finder, at + !here) : search_prev(finder, at);
+    if (i < 0) {
+        current_match = -1;
+        draw_status_bar("No match found.");
+        return;
+    }
+    size_t off = search_match(finder, i);
+    pthread_mutex_lock(&mutex);
+    move_cursor_to(off);
+    pthread_mutex_unlock(&mutex);
+    render_editor_buffer();
+    current_match = i;
+    show_match_status(i, dir > 0 ? off < at + !here : off >= at);
+}
+
+// 입력이 없는 동안 남은 곳을 이어서 훑고, 다 훑으면 결과 수를 고쳐 보여준다
+void search_in_background() {
+    if (search_done(finder)) return;
+    if (search_step(finder, SEARCH_IDLE_BYTES) > 0 && current_match >= 0) show_match_status(current_match, 0);
 }
 
 void run_in_gnome_terminal() {
@@ -366,21 +1057,6 @@ void run_in_gnome_terminal() {
     }
 }
 
-int is_cyan_keyword(const char* word) {
-    for (int i = 0; cyan_keywords[i] != NULL; i++) {
-        if (strcmp(word, cyan_keywords[i]) == 0) return 1;
-    }
-    return 0;
-}
-
-int is_magenta_keyword(const char* word) {
-    for (int i = 0; magenta_keywords[i] != NULL; i++) {
-        if (strcmp(word, magenta_keywords[i]) == 0) return 1;
-    }
-    return 0;
-}
-
-
 void show_editor_logo() {
     int unused_rows, cols;
     getmaxyx(stdscr, unused_rows, cols);
@@ -416,13 +1092,14 @@ void show_editor_logo() {
     werase(editor_win);
     box(editor_win, 0, 0);
     wrefresh(editor_win);
+    invalidate_editor_view();
 }
 
 
 void draw_menu_bar() {
     int cols = getmaxx(stdscr);
     const char* menu_text = " File  Build  Option  Help ";
-    const char* hint = "Ctrl+L: menu | F10: exit | F5: compile & run | Ctrl+F: find";
+    const char* hint = "Ctrl+L: menu | F10: exit | F5: compile & run | Ctrl+F: find | Ctrl+R: replace";
 
     // 메뉴바 왼쪽
     attron(COLOR_PAIR(2));
@@ -459,8 +1136,9 @@ void draw_status_bar(const char* message) {
     char right[cols + 1];
 
     snprintf(left, sizeof(left), " %s", status_message);
-    snprintf(right, sizeof(right), " %s | Ln %d, Col %d ", 
+    snprintf(right, sizeof(right), " %s%s | Ln %d, Col %d ", 
              (strlen(opened_filename) > 0) ? opened_filename : "[No File]",
+             doc_version(doc) != saved_version ? " [+]" : "",
              cursor_y + scroll_offset + 1, cursor_x + 1);
 
     int left_len = strlen(left);
@@ -476,82 +1154,204 @@ void draw_status_bar(const char* message) {
     refresh();
 }
 
-void render_editor_buffer() {
-    werase(editor_win);
-    box(editor_win, 0, 0);
-    int visible_lines = getmaxy(editor_win) - 2;
-    int gutter = show_line_numbers ? 4 : 0;
-    pthread_mutex_lock(&mutex);
-    for (int y = 0; y < visible_lines; y++) {
-        int buf_line = y + scroll_offset;
-        if (buf_line >= MAX_ROWS) continue;
+// 지난 프레임에 그린 내용. 바뀐 화면 줄만 다시 그리고, 스크롤은 터미널 스크롤로 옮긴다
+struct view_row {
+    unsigned long long hash;    // 그린 줄 내용(+줄 번호)의 해시. 0 이면 문서 끝 뒤의 빈 줄
+    int known;                  // 0 이면 화면에 무엇이 있는지 모름 (다시 그려야 함)
+};
+
+struct editor_view {
+    int valid;                  // 0 이면 다음 프레임은 창 전체를 다시 그린다
+    WINDOW* win;
+    int rows, cols;
+    int top;                    // 지난 프레임의 scroll_offset
+    int flags;                  // 줄 번호/강조/괄호 숨김 설정
+    document* doc;
+    unsigned long version;      // 지난 프레임의 doc_version
+    unsigned long hl_gen;       // 지난 프레임의 highlight_generation
+    unsigned long long marks;   // 지난 프레임에 칠한 검색어의 해시 (0 이면 없음)
+    struct view_row* row;
+} view;
+
+// 팝업이나 메뉴가 편집 창 위를 덮었을 때 부른다
+void invalidate_editor_view() {
+    view.valid = 0;
+}
+
+// 줄 내용과 줄 번호, 그 줄이 시작하는 렉서 상태의 해시 (구문 강조 구간은 이것들로 정해진다)
+// 칠한 검색 결과 자리도 섞는다
+unsigned long long line_hash(const char* line, int len, long number, int state,
+                             const struct hl_span* marks, int nmarks) {
+    unsigned long long h = 1469598103934665603ULL;     // FNV-1a
+    for (int i = 0; i < len; i++) h = (h ^ (unsigned char)line[i]) * 1099511628211ULL;
+    h = (h ^ (unsigned long long)number) * 1099511628211ULL;
+    h = (h ^ (unsigned long long)state) * 1099511628211ULL;
+    for (int i = 0; i < nmarks; i++) h = (h ^ (marks[i].start | (unsigned long long)marks[i].len << 32)) * 1099511628211ULL;
+    return h ? h : 1;
+}
+
+// 한 줄에서 칠할 검색 결과 자리 (겹치는 결과는 이어서 칠한다)
+#define MAX_MARKS 64
+int find_marks(const char* line, int len, struct hl_span* marks) {
+    int n = 0;
+    size_t mlen;
+    for (size_t p = 0; n < MAX_MARKS && (p = search_find_in(finder, line, p, len, &mlen)) < (size_t)len; p++) {
+        if (mlen == 0) continue;
+        if (n > 0 && marks[n - 1].start + marks[n - 1].len >= p) {
+            if (p + mlen > marks[n - 1].start + marks[n - 1].len) marks[n - 1].len = p + mlen - marks[n - 1].start;
+        } else {
+            marks[n++] = (struct hl_span){ p, mlen, 0 };
+        }
+    }
+    return n;
+}
+
+chtype token_color(int kind) {
+    switch (kind) {
+        case HL_STRING:
+        case HL_PREPROC: return COLOR_PAIR(5);
+        case HL_COMMENT: return COLOR_PAIR(6);
+        case HL_PUNCT: return COLOR_PAIR(7);
+        case HL_KEYWORD: return COLOR_PAIR(8);
+        case HL_TYPE: return COLOR_PAIR(9);
+    }
+    return 0;
+}
 
-        const char* line = editor_buf[buf_line];
-        int len = strlen(line);
-        int x = gutter + 1;
+// 화면 한 줄(양쪽 테두리 포함)을 색까지 붙여 모아 두는 버퍼
+chtype* row_cells = NULL;
+int row_cells_cap = 0;
 
+// 바이트 하나를 칸 하나로. 탭은 공백, 그 밖에 찍을 수 없는 글자는 unctrl 표기의 첫 글자로 보인다
+chtype text_cell(unsigned char c) {
+    if (c == '\t') return ' ';
+    if (c < 32 || c >= 127) return (unsigned char)unctrl(c)[0];
+    return c;
+}
+
+// 화면 y 번째 줄을 문서 buf_line 줄로 덮어쓴다 (line 이 NULL 이면 빈 줄)
+// spans 는 구문 강조 구간 (강조를 끄면 nspans 가 0), marks 는 반전해 보일 검색 결과 자리.
+// 줄 전체를 모아 한 번에 내보낸다
+void draw_editor_row(int y, const char* line, int len, int buf_line, const struct hl_span* spans, int nspans,
+                     const struct hl_span* marks, int nmarks) {
+    int width = view.cols + 2;
+    if (width > row_cells_cap) {
+        chtype* p = realloc(row_cells, width * sizeof(*p));
+        if (!p) return;
+        row_cells = p;
+        row_cells_cap = width;
+    }
+    chtype* cells = row_cells;
+    // wscrl 은 테두리까지 밀어 내므로 양쪽 세로선도 다시 긋는다
+    cells[0] = ACS_VLINE;
+    for (int x = 1; x <= view.cols; x++) cells[x] = ' ';
+    cells[width - 1] = ACS_VLINE;
+
+    if (line) {
+        int x = (show_line_numbers ? 4 : 0) + 1;
         if (show_line_numbers) {
-            mvwprintw(editor_win, y + 1, 1, "%3d", buf_line + 1);
-            mvwaddch(editor_win, y + 1, 4, ACS_VLINE);
+            char number[16];
+            snprintf(number, sizeof(number), "%3d", buf_line + 1);
+            for (int i = 0; number[i] && i + 1 <= view.cols; i++) cells[i + 1] = number[i];
+            if (view.cols >= 4) cells[4] = ACS_VLINE;
         }
 
-        for (int i = 0; i < len;) {
-            if (hide_brackets && (line[i] == '{' || line[i] == '}' || line[i] == '(' || line[i] == ')')) {
-                i++; x++;
-                continue;
-            }
+        int s = 0, m = 0;
+        for (int i = 0; i < len && x <= view.cols; i++, x++) {
+            char c = line[i];
+            if (hide_brackets && (c == '{' || c == '}' || c == '(' || c == ')')) continue;
+            while (s < nspans && spans[s].start + spans[s].len <= (unsigned)i) s++;
+            while (m < nmarks && marks[m].start + marks[m].len <= (unsigned)i) m++;
+            chtype color = s < nspans && spans[s].start <= (unsigned)i ? token_color(spans[s].kind) : 0;
+            if (m < nmarks && marks[m].start <= (unsigned)i) color |= A_REVERSE;
+            cells[x] = text_cell(c) | color;
+        }
+    }
+    mvwaddchnstr(editor_win, y + 1, 0, cells, width);
+}
 
-            if (show_syntax_highlight && line[i] == '\"') {
-                wattron(editor_win, COLOR_PAIR(5));
-                mvwaddch(editor_win, y + 1, x++, line[i++]);
-                while (i < len && !(line[i] == '\"' && line[i - 1] != '\\')) {
-                    mvwaddch(editor_win, y + 1, x++, line[i++]);
-                }
-                if (i < len) mvwaddch(editor_win, y + 1, x++, line[i++]);
-                wattroff(editor_win, COLOR_PAIR(5));
-            } else if (show_syntax_highlight && i == 0 && line[i] == '#') {
-                wattron(editor_win, COLOR_PAIR(5));
-                while (i < len) mvwaddch(editor_win, y + 1, x++, line[i++]);
-                wattroff(editor_win, COLOR_PAIR(5));
-                break;
-            } else if (show_syntax_highlight && line[i] == '/' && line[i + 1] == '/') {
-                wattron(editor_win, COLOR_PAIR(6));
-                while (i < len) mvwaddch(editor_win, y + 1, x++, line[i++]);
-                wattroff(editor_win, COLOR_PAIR(6));
-                break;
-            } else if (line[i] == ';') {
-                if (show_syntax_highlight) wattron(editor_win, COLOR_PAIR(7));
-                mvwaddch(editor_win, y + 1, x++, line[i++]);
-                if (show_syntax_highlight) wattroff(editor_win, COLOR_PAIR(7));
-            } else if (isalpha(line[i]) || line[i] == '_') {
-                char word[64] = {0};
-                int j = 0;
-                while ((isalnum(line[i]) || line[i] == '_') && j < 63) {
-                    word[j++] = line[i++];
-                }
-                word[j] = '\0';
-
-                if (show_syntax_highlight && is_cyan_keyword(word)) {
-                    wattron(editor_win, COLOR_PAIR(9));
-                    mvwprintw(editor_win, y + 1, x, "%s", word);
-                    wattroff(editor_win, COLOR_PAIR(9));
-                } else if (show_syntax_highlight && is_magenta_keyword(word)) {
-                    wattron(editor_win, COLOR_PAIR(8));
-                    mvwprintw(editor_win, y + 1, x, "%s", word);
-                    wattroff(editor_win, COLOR_PAIR(8));
-                } else {
-                    mvwprintw(editor_win, y + 1, x, "%s", word);
-                }
-                x += strlen(word);
+// 지난 프레임과 달라진 화면 줄만 다시 그린다.
+// 커서만 움직였으면 줄을 읽지도 않고, 스크롤은 wscrl 로 밀어 새로 드러난 줄만 그린다
+void render_editor_buffer() {
+    int rows = getmaxy(editor_win) - 2;
+    int cols = getmaxx(editor_win) - 2;
+    int flags = show_line_numbers | show_syntax_highlight << 1 | hide_brackets << 2;
+
+    if (!view.valid || view.win != editor_win || view.rows != rows || view.cols != cols ||
+        view.flags != flags || view.doc != doc) {
+        struct view_row* r = realloc(view.row, (rows > 0 ? rows : 1) * sizeof(*r));
+        if (!r) return;
+        view.row = r;
+        memset(view.row, 0, (rows > 0 ? rows : 1) * sizeof(*r));
+        view.valid = 1;
+        view.win = editor_win;
+        view.rows = rows;
+        view.cols = cols;
+        view.flags = flags;
+        view.doc = doc;
+        view.top = scroll_offset;
+        werase(editor_win);
+        box(editor_win, 0, 0);
+        touchwin(editor_win);
+        idlok(editor_win, TRUE);
+        if (rows > 0) wsetscrreg(editor_win, 1, rows);
+    } else if (scroll_offset != view.top) {
+        int delta = scroll_offset - view.top;
+        if (abs(delta) < rows) {
+            // 테두리 안쪽만 스크롤 영역으로 잡고 밀어 올리거나 내린다
+            scrollok(editor_win, TRUE);
+            wscrl(editor_win, delta);
+            scrollok(editor_win, FALSE);
+            if (delta > 0) {
+                memmove(view.row, view.row + delta, (rows - delta) * sizeof(*view.row));
+                memset(view.row + rows - delta, 0, delta * sizeof(*view.row));
             } else {
-                mvwaddch(editor_win, y + 1, x++, line[i++]);
+                memmove(view.row - delta, view.row, (rows + delta) * sizeof(*view.row));
+                memset(view.row, 0, -delta * sizeof(*view.row));
             }
+        } else {
+            memset(view.row, 0, rows * sizeof(*view.row));
         }
-        pthread_mutex_unlock(&mutex);
-        if (y == cursor_y) {
-            wmove(editor_win, y + 1, cursor_x);
+        view.top = scroll_offset;
+    }
+
+    pthread_mutex_lock(&mutex);
+    // 검색 중이면 보이는 결과를 칠한다 (검색한 뒤로 편집했으면 칠하지 않는다)
+    int show_marks = 0;
+    unsigned long long marks_key = 0;
+    if (search_active(finder) && search_version(finder) == doc_version(doc)) {
+        const char* query = search_query(finder);
+        show_marks = 1;
+        marks_key = line_hash(query, strlen(query), search_is_pattern(finder), 0, NULL, 0);
+    }
+    int stale = doc_version(doc) != view.version || highlight_generation(syntax) != view.hl_gen ||
+                marks_key != view.marks;
+    for (int y = 0; y < rows && !stale; y++) stale = !view.row[y].known;
+    if (stale) {
+        for (int y = 0; y < rows; y++) {
+            int buf_line = y + scroll_offset;
+            unsigned long long h = 0;
+            int len = -1, nspans = 0, state = 0, nmarks = 0;
+            const struct hl_span* spans = NULL;
+            struct hl_span marks[MAX_MARKS];
+            if (doc_line_exists(doc, buf_line)) {
+                len = doc_get_line(doc, buf_line, &line_buf, &line_cap);
+                if (show_syntax_highlight) nspans = highlight_line(syntax, doc, buf_line, &spans, &state);
+                if (nspans < 0) nspans = 0;
+                if (show_marks) nmarks = find_marks(line_buf, len, marks);
+                h = line_hash(line_buf, len, show_line_numbers ? buf_line : -1, state, marks, nmarks);
+            }
+            if (view.row[y].known && view.row[y].hash == h) continue;
+            draw_editor_row(y, len >= 0 ? line_buf : NULL, len, buf_line, spans, nspans, marks, nmarks);
+            view.row[y].hash = h;
+            view.row[y].known = 1;
         }
+        view.version = doc_version(doc);
+        view.hl_gen = highlight_generation(syntax);
+        view.marks = marks_key;
     }
+    pthread_mutex_unlock(&mutex);
+
     int max_y = getmaxy(editor_win) - 2;
     int max_x = getmaxx(editor_win) - 2;
     if (cursor_y >= max_y) cursor_y = max_y - 1;
@@ -563,44 +1363,75 @@ void render_editor_buffer() {
     wrefresh(editor_win);
 }
 
+// 구문 강조 스레드가 아래쪽 상태를 새로 채웠으면 화면을 맞춘다 (달라진 줄만 다시 그려진다)
+void refresh_highlight() {
+    pthread_mutex_lock(&mutex);
+    int changed = highlight_generation(syntax) != view.hl_gen;
+    pthread_mutex_unlock(&mutex);
+    if (changed && current_menu == -1 && editor_win) render_editor_buffer();
+}
+
 
+// 바로 저장이 끝나야 하는 곳(컴파일, 종료)에서 쓰는 동기 저장
 void save_current_file() {
+    pthread_mutex_lock(&io_mutex);
     pthread_mutex_lock(&mutex);
     const char* filename = (strlen(opened_filename) > 0) ? opened_filename : "untitled.txt";
-    FILE* fp = fopen(filename, "w");
-    if (!fp) {
-        draw_status_bar("Failed to save file.");
-        return;
-    }
-    for (int i = 0; i < MAX_ROWS; i++) {
-        fprintf(fp, "%s\n", editor_buf[i]);
+    // 임시 파일에 쓴 뒤 rename 으로 바꿔 끼우므로 저장 도중 죽어도 원본이 남는다
+    int ok = doc_save(doc, filename) == 0;
+    if (ok) {
+        char* batch;
+        saved_version = doc_version(doc);
+        if (filename == opened_filename) {
+            journal_take(swap_journal, &batch);    // 모두 파일에 들어갔으므로 버린다
+            free(batch);
+            journal_reset(swap_journal);
+        }
     }
-    fclose(fp);
-    draw_status_bar("Saved to file.");
     pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&io_mutex);
+    draw_status_bar(ok ? "Saved to file." : "Failed to save file.");
+}
+
+// 편집 중에 쓰는 저장. 저장 스레드에 맡기고 바로 돌아온다
+void save_file_async() {
+    draw_status_bar("Saving...");
+    saver_request(&saver_save);
 }
 
 void tap(int actual_row, int actual_col){
-    if (strlen(editor_buf[actual_row]) + 4 < MAX_COLS - 1) {
-        for (int i = 0; i < 4; i++) {
-            memmove(&editor_buf[actual_row][actual_col + 1],
-                    &editor_buf[actual_row][actual_col],
-                    strlen(&editor_buf[actual_row][actual_col]) + 1);
-            editor_buf[actual_row][actual_col++] = ' ';
-            cursor_x++;
-        }
-    }
+    doc_insert_at(doc, actual_row, actual_col, "    ", 4);
+    cursor_x += 4;
 }
 
 void countBlock(int actual_row, int actual_col){
+    // 바로 위의 비어있지 않은 줄의 들여쓰기를 기준으로 깊이를 정한다
+    // (문서 처음부터 괄호를 세지 않으므로 파일 크기와 무관)
     int count = 0;
-    for(int i = 0; i <= actual_row; i++){
-        if(strchr(editor_buf[i], '{'))
+    int prev = actual_row - 1;
+    while (prev > 0 && doc_line_length(doc, prev) == 0) prev--;
+
+    if (prev >= 0) {
+        int len = doc_get_line(doc, prev, &line_buf, &line_cap);
+        int spaces = 0, tabs = 0, k = 0;
+        for (; k < len && (line_buf[k] == ' ' || line_buf[k] == '\t'); k++) {
+            if (line_buf[k] == '\t') tabs++;
+            else spaces++;
+        }
+        count = spaces / 4 + tabs;
+
+        int last = len - 1;
+        while (last >= k && isspace((unsigned char)line_buf[last])) last--;
+        if (last >= k && line_buf[last] == '{')
             count++;
-        if(strchr(editor_buf[i], '}'))
-            count--;
     }
 
+    int len = doc_get_line(doc, actual_row, &line_buf, &line_cap);
+    int k = actual_col;
+    while (k < len && isspace((unsigned char)line_buf[k])) k++;
+    if (k < len && line_buf[k] == '}' && count > 0)
+        count--;
+
     for(int i = 0; i < count; i++){
         tap(actual_row, actual_col);
     }
@@ -609,13 +1440,22 @@ void countBlock(int actual_row, int actual_col){
 void handle_key_input(int ch) {
     
     if (!input_enabled || !editor_win) return;
+    // 자동 저장 스레드와 문서를 함께 쓰므로 편집하는 동안 잠근다
+    pthread_mutex_lock(&mutex);
+    // 키 하나로 생긴 편집(엔터의 들여쓰기, 괄호 짝 등)은 한 번에 되돌린다
+    undo_begin(history);
     int visible_lines = getmaxy(editor_win) - 2;
     int actual_row = cursor_y + scroll_offset;
     int gutter = show_line_numbers ? 4 : 0;
     int actual_col = cursor_x - gutter;
+    int has_next = doc_line_exists(doc, actual_row + 1);
+    int line_len = doc_line_length(doc, actual_row);
+    if (actual_col < 0) actual_col = 0;
+    if (actual_col > line_len) actual_col = line_len;
 
     switch (ch) {
         case KEY_LEFT: // 왼쪽으로 이동
+            undo_seal(history);
             if (cursor_x > gutter) {
                 cursor_x--;
             } else if (cursor_y > 0 || scroll_offset > 0) {
@@ -626,23 +1466,25 @@ void handle_key_input(int ch) {
                     scroll_offset--;
                 }
                 actual_row = cursor_y + scroll_offset;
-                cursor_x = strlen(editor_buf[actual_row]) + gutter;
+                cursor_x = doc_line_length(doc, actual_row) + gutter;
             }
             break;
 
         case KEY_RIGHT: // 오른쪽으로 이동
-            if (editor_buf[actual_row][actual_col] != '\0' && cursor_x < MAX_COLS - 2) {
+            undo_seal(history);
+            if (actual_col < line_len) {
                 cursor_x++;
-            } else if (cursor_y < visible_lines - 1 && actual_row + 1 < MAX_ROWS) {
+            } else if (cursor_y < visible_lines - 1 && has_next) {
                 cursor_y++;
                 cursor_x = gutter;
-            } else if (scroll_offset + visible_lines < MAX_ROWS) {
+            } else if (has_next) {
                 scroll_offset++;
                 cursor_x = gutter;
             }
             break;
 
         case KEY_UP: // 위로 이동
+            undo_seal(history);
             if (cursor_y > 0) {
                 cursor_y--;
             } else if (scroll_offset > 0) {
@@ -650,146 +1492,153 @@ void handle_key_input(int ch) {
             }
             //그 줄의 뒤로 가도록 계산 
             actual_row = cursor_y + scroll_offset;
-            cursor_x = strlen(editor_buf[actual_row]) + gutter;
+            cursor_x = doc_line_length(doc, actual_row) + gutter;
             break;
 
         case KEY_DOWN:
-            if (cursor_y < visible_lines - 1 && actual_row + 1 < MAX_ROWS) {
+            undo_seal(history);
+            if (cursor_y < visible_lines - 1 && has_next) {
                 cursor_y++;
-            } else if (scroll_offset +
-                visible_lines < MAX_ROWS) {
+            } else if (has_next) {
                 scroll_offset++;
             }
             //그 줄의 뒤로 가도록 계산 
             actual_row = cursor_y + scroll_offset;
-            cursor_x = strlen(editor_buf[actual_row]) + gutter;
+            cursor_x = doc_line_length(doc, actual_row) + gutter;
             break;
 
         case KEY_BACKSPACE:
         case 127:
         case 8:
-            pthread_mutex_lock(&mutex);
-            if (cursor_x > gutter) {
-                memmove(&editor_buf[actual_row][actual_col - 1],
-                        &editor_buf[actual_row][actual_col],
-                        strlen(&editor_buf[actual_row][actual_col]) + 1);
-                cursor_x--;
+            if (actual_col > 0) {
+                doc_delete_at(doc, actual_row, actual_col - 1, 1);
+                cursor_x = actual_col - 1 + gutter;
             } else if (actual_row > 0) {
-                int prev_len = strlen(editor_buf[actual_row - 1]);
-                if (prev_len + strlen(editor_buf[actual_row]) < MAX_COLS) {
+                int prev_len = doc_line_length(doc, actual_row - 1);
 
-                    strcat(editor_buf[actual_row - 1], editor_buf[actual_row]);
-
-                    for (int i = actual_row; i < MAX_ROWS - 1; i++) {
-                        strcpy(editor_buf[i], editor_buf[i + 1]);
-                    }
+                // 윗줄 끝의 개행("\n" 또는 "\r\n")을 지워 두 줄을 합친다
+                size_t eol = doc_line_offset(doc, actual_row - 1) + prev_len;
+                doc_delete(doc, eol, doc_line_offset(doc, actual_row) - eol);
 
-                    if (cursor_y > 0) {
-                        cursor_y--;
-                    } else {
-                        scroll_offset--;
-                    }
-                    actual_row = cursor_y + scroll_offset;
-                    cursor_x = prev_len + gutter;
+                if (cursor_y > 0) {
+                    cursor_y--;
+                } else {
+                    scroll_offset--;
                 }
+                actual_row = cursor_y + scroll_offset;
+                cursor_x = prev_len + gutter;
             }
-            pthread_mutex_unlock(&mutex);
             break;
 
         case 10:  // Enter
-            pthread_mutex_lock(&mutex);
-            if(editor_buf[actual_row][actual_col - 1] == '{' && editor_buf[actual_row][actual_col] == '}'
-                && actual_row < MAX_ROWS - 2){
-                    for(int k = 0; k < 2; k++){
-                        for (int i = MAX_ROWS - 2; i > actual_row; i--) {
-                            strcpy(editor_buf[i + 1], editor_buf[i]);
-                        }
-                        strcpy(editor_buf[actual_row + 1], &editor_buf[actual_row][actual_col]);
-                        editor_buf[actual_row][actual_col] = '\0';
-
-                        if (cursor_y < visible_lines - 1) {
-                            cursor_y++;
-                        } else {
-                            scroll_offset++;
-                        }
-                        cursor_x = gutter;
-                        actual_col = 0;
-                        actual_row = cursor_y + scroll_offset;
-                    }
-                    countBlock(actual_row, actual_col);
-                    cursor_y--;
-                    cursor_x = gutter;
-                    actual_col = 0;
-                    actual_row = cursor_y + scroll_offset;
-                }
-            else if (actual_row < MAX_ROWS - 1) {
-                for (int i = MAX_ROWS - 2; i > actual_row; i--) {
-                    strcpy(editor_buf[i + 1], editor_buf[i]);
-                }
-                strcpy(editor_buf[actual_row + 1], &editor_buf[actual_row][actual_col]);
-                editor_buf[actual_row][actual_col] = '\0';
+            doc_get_line(doc, actual_row, &line_buf, &line_cap);
+            const char* eol = doc_eol(doc);
+            if (actual_col > 0 && line_buf[actual_col - 1] == '{' && line_buf[actual_col] == '}') {
+                // {|} 사이에서 엔터: 빈 줄을 하나 끼우고 닫는 괄호 줄도 들여쓴다
+                doc_insert_at(doc, actual_row, actual_col, eol, strlen(eol));
+                doc_insert_at(doc, actual_row, actual_col, eol, strlen(eol));
+                countBlock(actual_row + 2, 0);
+            } else {
+                doc_insert_at(doc, actual_row, actual_col, eol, strlen(eol));
+            }
 
-                if (cursor_y < visible_lines - 1) {
-                    cursor_y++;
-                } else {
-                    scroll_offset++;
-                }
-                cursor_x = gutter;
-                actual_col = 0;
-                actual_row = cursor_y + scroll_offset;
+            if (cursor_y < visible_lines - 1) {
+                cursor_y++;
+            } else {
+                scroll_offset++;
             }
+            cursor_x = gutter;
+            actual_col = 0;
+            actual_row = cursor_y + scroll_offset;
             countBlock(actual_row, actual_col);
-            pthread_mutex_unlock(&mutex);
             break;
 
         default:
             if (ch == '\t') {
                 // 탭 키 입력 시 공백 4칸 삽입
+                cursor_x = actual_col + gutter;
                 tap(actual_row, actual_col);
-            } else if (ch >= 32 && ch <= 126 && strlen(editor_buf[actual_row]) < MAX_COLS - 1) {
-                pthread_mutex_lock(&mutex);
-                if(ch == '{') {
-                    memmove(&editor_buf[actual_row][actual_col + 2],
-                            &editor_buf[actual_row][actual_col],
-                            strlen(&editor_buf[actual_row][actual_col]) + 2);
-                    editor_buf[actual_row][actual_col++] = '{';
-                    editor_buf[actual_row][actual_col] = '}';
-                    cursor_x += 1;
-                }
-                else if(ch == '(') {
-                    memmove(&editor_buf[actual_row][actual_col + 2],
-                            &editor_buf[actual_row][actual_col],
-                            strlen(&editor_buf[actual_row][actual_col]) + 2);
-                    editor_buf[actual_row][actual_col++] = '(';
-                    editor_buf[actual_row][actual_col] = ')';
-                    cursor_x += 1;
+            } else if (ch >= 32 && ch <= 126) {
+                // 여는 괄호/따옴표는 짝을 함께 넣고 커서는 그 사이에 둔다
+                char text[2] = { ch, ch };
+                int n = 1;
+                if (ch == '{') {
+                    text[1] = '}';
+                    n = 2;
+                } else if (ch == '(') {
+                    text[1] = ')';
+                    n = 2;
+                } else if (ch == '\"' || ch == '\'') {
+                    n = 2;
                 }
-                else if(ch == '\"' || ch == '\'') {
-                    memmove(&editor_buf[actual_row][actual_col + 2],
-                            &editor_buf[actual_row][actual_col],
-                            strlen(&editor_buf[actual_row][actual_col]) + 2);
-                    editor_buf[actual_row][actual_col++] = ch;
-                    editor_buf[actual_row][actual_col] = ch;
-                    cursor_x += 1;
-                }
-                else{
-                    memmove(&editor_buf[actual_row][actual_col + 1],
-                            &editor_buf[actual_row][actual_col],
-                            strlen(&editor_buf[actual_row][actual_col]) + 1);
-                            editor_buf[actual_row][actual_col] = ch;
-                            cursor_x++;
-                }
-                pthread_mutex_unlock(&mutex);
+                doc_insert_at(doc, actual_row, actual_col, text, n);
+                cursor_x = actual_col + 1 + gutter;
             }
             break;
-        
     }
-    int line_len = strlen(editor_buf[actual_row]);
-    if (actual_col > line_len) cursor_x = line_len + gutter;
+    actual_row = cursor_y + scroll_offset;
+    line_len = doc_line_length(doc, actual_row);
+    if (cursor_x - gutter > line_len) cursor_x = line_len + gutter;
+    undo_end(history);
+    pthread_mutex_unlock(&mutex);
     render_editor_buffer();
 }
 
 
+// 지금 문서를 닫아도 되는지 묻는다. 저장하지 않은 편집이 있으면 저장/버리기/취소를 고르게 한다.
+// 계속해도 되면 1 이고 버리기로 했으면 *discard 가 1. 취소하거나 저장에 실패하면 0
+int close_current_file(int* discard) {
+    char answer[256] = "";
+    pthread_mutex_lock(&mutex);
+    int dirty = doc_version(doc) != saved_version;
+    pthread_mutex_unlock(&mutex);
+    *discard = 0;
+    if (!dirty) return 1;
+    if (!get_user_input("Unsaved changes. (s)ave, (d)iscard, (c)ancel?", answer)) return 0;
+    if (answer[0] == 'd' || answer[0] == 'D') return *discard = 1;
+    if (answer[0] != 's' && answer[0] != 'S') return 0;
+    save_current_file();
+    pthread_mutex_lock(&mutex);
+    int saved = doc_version(doc) == saved_version;
+    pthread_mutex_unlock(&mutex);
+    return saved;   // 저장에 실패했으면 열지 않는다
+}
+
+// path 를 열어 지금 문서로 바꾼다. 지난번에 저장하지 못한 편집이 남아 있으면 되살릴지 묻는다.
+// 지금 문서를 닫지 않기로 했거나 열지 못하면 상태 줄에 알리고 0
+int open_file(const char* path) {
+    int discard;
+    document* opened = NULL;
+    if (!close_current_file(&discard)) {
+        draw_status_bar("Open cancelled.");
+        return 0;
+    }
+    if (strlen(path) >= sizeof(opened_filename) || (opened = doc_open(path)) == NULL) {
+        draw_status_bar("Failed to open file.");
+        return 0;
+    }
+    int keep = 0;
+    char answer[256] = "";
+    if (journal_exists(path) &&
+        get_user_input("Swap file found. Recover unsaved changes? (y/n)", answer) &&
+        (answer[0] == 'y' || answer[0] == 'Y'))
+        keep = journal_replay(path, opened) >= 0;
+
+    pthread_mutex_lock(&io_mutex);
+    pthread_mutex_lock(&mutex);
+    keep_undo_history();
+    detach_journal(discard);
+    doc_free(doc);
+    doc = opened;
+    attach_journal(path, keep);
+    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&io_mutex);
+    strcpy(opened_filename, path);
+    input_enabled = 1;
+    cursor_x = cursor_y = scroll_offset = 0;
+    return 1;
+}
+
 void show_file_list_popup() {
     DIR* dir;
     struct dirent* entry;
@@ -803,6 +1652,12 @@ void show_file_list_popup() {
     }
 
     while ((entry = readdir(dir)) != NULL && count < MAX_FILES) {
+        size_t name_len = strlen(entry->d_name);
+        // 스왑 저널(.이름.swp)과 되돌리기 기록(.이름.undo)은 목록에 보이지 않게 한다
+        if (entry->d_name[0] == '.' && name_len > 4 && strcmp(entry->d_name + name_len - 4, ".swp") == 0)
+            continue;
+        if (entry->d_name[0] == '.' && name_len > 5 && strcmp(entry->d_name + name_len - 5, ".undo") == 0)
+            continue;
         if (entry->d_type == DT_REG) {
             files[count] = strdup(entry->d_name);
             count++;
@@ -844,22 +1699,8 @@ void show_file_list_popup() {
             if (highlight < count - 1) highlight++;
             if (highlight >= offset + (win_h - 4)) offset++;
         } else if (ch == 10) {
-            FILE* fp = fopen(files[highlight], "r");
-            if (fp) {
-                memset(editor_buf, 0, sizeof(editor_buf));
-                int row = 0;
-                while (fgets(editor_buf[row], MAX_COLS, fp) && row < MAX_ROWS - 1) {
-                    editor_buf[row][strcspn(editor_buf[row], "\n")] = '\0';
-                    row++;
-                }
-                fclose(fp);
-                strcpy(opened_filename, files[highlight]);
-                input_enabled = 1;
-                cursor_x = cursor_y = 0;
-                render_editor_buffer();
-            } else {
-                draw_status_bar("Failed to open file.");
-            }
+            open_file(files[highlight]);
+            render_editor_buffer();
             break;
         } else if (ch == 27) {
             break;
@@ -870,6 +1711,7 @@ void show_file_list_popup() {
     delwin(popup);
     touchwin(stdscr);
     refresh();
+    invalidate_editor_view();
     box(editor_win, 0, 0);
     wrefresh(editor_win);
 }
@@ -887,7 +1729,7 @@ void draw_dropdown(int menu_index) {
         count = 2;
     } else if (menu_index == 2) {
         menu_items = option_menu;
-        count = 5;
+        count = 6;
     } else if (menu_index == 3) {
         menu_items = help_menu;
         count = 2;
@@ -909,11 +1751,12 @@ void clear_dropdown(int menu_index) {
         move(1 + i, x);
         clrtoeol();
     }
+    refresh();
+    // 드롭다운이 덮었던 편집 창을 다시 그린다
     if (editor_win) {
-        box(editor_win, 0, 0);
-        wrefresh(editor_win);
+        invalidate_editor_view();
+        render_editor_buffer();
     }
-    refresh();
 }
 
 int handle_menu_input(int ch) {
@@ -959,8 +1802,19 @@ int handle_menu_input(int ch) {
                     draw_status_bar(file_menu[current_item]);
                     if (strcmp(file_menu[current_item], "New") == 0) {
                         char newname[256] = "";
-                        if (get_filename_from_user(newname)) {
-                            memset(editor_buf, 0, sizeof(editor_buf));
+                        document* fresh;
+                        int discard;
+                        if (close_current_file(&discard) && get_filename_from_user(newname) &&
+                            (fresh = doc_new()) != NULL) {
+                            pthread_mutex_lock(&io_mutex);
+                            pthread_mutex_lock(&mutex);
+                            keep_undo_history();
+                            detach_journal(discard);
+                            doc_free(doc);
+                            doc = fresh;
+                            attach_journal(newname, 0);
+                            pthread_mutex_unlock(&mutex);
+                            pthread_mutex_unlock(&io_mutex);
                             cursor_x = cursor_y = scroll_offset = 0;
                             strcpy(opened_filename, newname);
                             input_enabled = 1;
@@ -972,11 +1826,11 @@ int handle_menu_input(int ch) {
                     } else if (strcmp(file_menu[current_item], "Open") == 0) {
                         show_file_list_popup();
                     } else if (strcmp(file_menu[current_item], "Save") == 0) {
-                        save_current_file();
+                        save_file_async();
                     } else if (strcmp(file_menu[current_item], "Exit") == 0) {
+                        // 저장한 뒤 F10 과 같은 종료 경로로 나간다 (되돌리기 기록과 터미널 모드 정리)
                         save_current_file();
-                        endwin();
-                        exit(0);
+                        quit_requested = 1;
                     }
                 } else if (current_menu == 1) { // Build
                         const char* item = build_menu[current_item];
@@ -1006,11 +1860,7 @@ int handle_menu_input(int ch) {
                     } else if (strcmp(item, "AutoSave") == 0) {
                         autosave_enabled = !autosave_enabled;
                         draw_status_bar(autosave_enabled ? "AutoSave ON" : "AutoSave OFF");
-                        if (autosave_enabled) {
-                            alarm(5);  // 시작
-                        } else {
-                            alarm(0);  // 해제
-                        }
+                        saver_request(&saver_rearm);  // 지금부터 주기를 다시 센다
                     }else if (strcmp(item, "Seconds") == 0) {
                         char input[256] = "";
                         if (get_user_input("Enter autosave interval (sec):", input)) {
@@ -1018,15 +1868,28 @@ int handle_menu_input(int ch) {
                             if (t >= 1 && t <= 3600) {  // 1초 ~ 1시간 범위 제한
                                 autosave_tick = t;
                                 draw_status_bar("AutoSave interval updated.");
-                                if (autosave_enabled) {
-                                    alarm(autosave_tick);  // 즉시 재설정
-                                }
+                                saver_request(&saver_rearm);  // 즉시 재설정
                             } else {
                                 draw_status_bar("Invalid interval value (1–3600 sec only).");
                             }
                         } else {
                             draw_status_bar("Interval input cancelled.");
                         }
+                    } else if (strcmp(item, "UndoMB") == 0) {
+                        char input[256] = "";
+                        if (get_user_input("Enter undo memory budget (MB):", input)) {
+                            int mb = atoi(input);
+                            if (mb >= 1 && mb <= 4096) {
+                                pthread_mutex_lock(&mutex);
+                                undo_set_budget(history, (size_t)mb * 1024 * 1024);
+                                pthread_mutex_unlock(&mutex);
+                                draw_status_bar("Undo budget updated.");
+                            } else {
+                                draw_status_bar("Invalid budget (1–4096 MB only).");
+                            }
+                        } else {
+                            draw_status_bar("Budget input cancelled.");
+                        }
                     }
                     render_editor_buffer();
                 } else if (current_menu == 3) { // Help
@@ -1085,13 +1948,16 @@ int get_filename_from_user(char* out_filename) {
 
     echo();
     curs_set(1);
+    set_bracketed_paste(0);
     mvwgetnstr(input_win, 2, 2, out_filename, 255);
+    set_bracketed_paste(1);
     noecho();
     curs_set(0);
 
     delwin(input_win);
     touchwin(stdscr);
     refresh();
+    invalidate_editor_view();
     return strlen(out_filename) > 0;
 }
 
@@ -1099,12 +1965,41 @@ int get_filename_from_user(char* out_filename) {
 
 int main() {
     
+    // 클립보드 데몬을 fork 로 띄울 수 있으므로 스레드를 만들기 전에 고른다
+    clipboard_init();
+    doc = doc_new();
+    syntax = highlight_new();
+    finder = search_new();
+    history = undo_new(UNDO_BUDGET);
+    if (!doc || !syntax || !finder || !history) {
+        perror("doc_new");
+        return 1;
+    }
+    attach_journal(NULL, 0);
+    // 실패하면 스레드 없이 화면에 필요한 줄까지 직접 분석한다
+    highlight_start(syntax, &mutex);
+
     initscr();
     set_escdelay(25);  // 25ms로 줄임 (기본값은 보통 1000ms)
     signal(SIGWINCH, handle_resize);
+    signal(SIGPIPE, SIG_IGN);     // 클립보드를 받다가 먼저 끝난 tmux/데몬 때문에 죽지 않게
     noecho();
     cbreak();
     keypad(stdscr, TRUE);
+    // 붙여 넣기를 ESC[200~ ... ESC[201~ 로 감싸 보내게 한다. 표시는 키 하나로 받으므로
+    // 검색어 입력처럼 키를 직접 읽는 곳에서는 표시가 무시되고 내용만 글자로 들어간다
+    define_key("\033[200~", KEY_PASTE_BEGIN);
+    define_key("\033[201~", KEY_PASTE_END);
+    set_bracketed_paste(1);
+    // Ctrl+Z 는 되돌리기, Ctrl+V 는 붙여 넣기로 쓰므로 터미널이 일시 정지 신호나 다음 글자 그대로 넣기로
+    // 바꾸지 않게 한다 (endwin 때 원래대로 돌아간다)
+    struct termios tio;
+    if (tcgetattr(STDIN_FILENO, &tio) == 0) {
+        tio.c_cc[VSUSP] = _POSIX_VDISABLE;
+        tio.c_cc[VLNEXT] = _POSIX_VDISABLE;
+        tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+        def_prog_mode();
+    }
     curs_set(2);
     
     start_color();
@@ -1124,10 +2019,24 @@ int main() {
     show_editor_logo();     // 로고 출력 후 키 입력 대기
     render_editor_buffer(); // 편집기 초기화
     
-    signal(SIGALRM, autoSaveHandler);
+    if (pthread_create(&saver, NULL, saver_main, NULL) != 0) {
+        endwin();
+        perror("can't create saver thread");
+        return 1;
+    }
     draw_status_bar("Welcome to the Nice editor! Press F1 to Guide.");
+    // 입력이 없을 때도 주기적으로 깨어나 저장 스레드가 남긴 메시지를 보여준다
     int ch;
-    while ((ch = getch()) != KEY_F(10)) {
+    for (;;) {
+        // 검색이 덜 끝났으면 기다리지 않고 돌아와 조금씩 이어서 훑는다
+        timeout(search_done(finder) ? 200 : 0);
+        if ((ch = getch()) == KEY_F(10)) break;
+        if (ch == ERR) {
+            drain_status();
+            refresh_highlight();
+            search_in_background();
+            continue;
+        }
         // Alt+S 입력 감지: ESC → 's'
         if (ch == 27) { // ESC
             if (current_menu != -1) {
@@ -1140,12 +2049,13 @@ int main() {
             }
 
             // Alt+조합키 감지용: 예) Alt+S
+            timeout(200);
             int next = getch();  // 조합 키 처리
             if (next == 's' || next == 'S') {
-                save_current_file();
+                save_file_async();
                 continue;
             }
-            ungetch(next); // 아니면 다음 키를 되돌리기
+            if (next != ERR) ungetch(next); // 아니면 다음 키를 되돌리기
         }
             if (ch == KEY_F(5)) {
             run_in_gnome_terminal();
@@ -1159,13 +2069,63 @@ int main() {
             search_text();
             continue;
         }
+        if (ch == 18) {     // Ctrl+R
+            replace_text();
+            continue;
+        }
+        if (ch == 7) {      // Ctrl+G
+            find_in_files();
+            continue;
+        }
+        if (ch == 26 || ch == 25) {     // Ctrl+Z / Ctrl+Y
+            undo_edit(ch == 25);
+            continue;
+        }
+        if (ch == KEY_PASTE_BEGIN) {
+            bracketed_paste();
+            continue;
+        }
+        if (ch == 11) {     // Ctrl+K
+            copy();
+            continue;
+        }
+        if (ch == 22) {     // Ctrl+V
+            paste();
+            continue;
+        }
+        if (ch == KEY_F(3) || ch == KEY_F(15)) {   // F3 / Shift+F3
+            find_match(ch == KEY_F(3) ? 1 : -1, 0);
+            continue;
+        }
 
         if (!handle_menu_input(ch)) {
             handle_key_input(ch);
         }
+        if (quit_requested) break;
+
+        // 저널에 많이 쌓였으면 자동 저장 주기를 기다리지 않고 쓴다
+        pthread_mutex_lock(&mutex);
+        int backlog = journal_pending(swap_journal) >= JOURNAL_FLUSH_AT;
+        pthread_mutex_unlock(&mutex);
+        if (backlog) saver_request(&saver_flush);
+        drain_status();
     }
+    saver_stop();
+    highlight_free(syntax);
+    search_free(finder);
+    grep_cache_clear();
+
 
+    // 저장하지 않은 편집이 있으면 스왑 파일을 남겨 다음에 열 때 되살릴 수 있게 한다
+    pthread_mutex_lock(&mutex);
+    detach_journal(0);
+    keep_undo_history();
+    undo_free(history);
+    clipboard_clear();
+    doc_free(doc);
+    pthread_mutex_unlock(&mutex);
 
     endwin();
+    set_bracketed_paste(0);
     return 0;
 }
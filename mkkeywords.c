@@ -0,0 +1,176 @@
+// keywords.txt 를 읽어 keyword_class() 본체를 만드는 빌드 도구
+// 사용법: mkkeywords keywords.txt > keywords.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_KEYWORDS 1024
+
+struct keyword {
+    char word[64];
+    char cls[32];
+    int langs;
+};
+
+struct keyword keywords[MAX_KEYWORDS];
+int count = 0;
+
+// 길이, 첫 글자 순으로 모아 같은 분기에 들어가게 한다
+int compare(const void* a, const void* b) {
+    const struct keyword* x = a;
+    const struct keyword* y = b;
+    size_t lx = strlen(x->word), ly = strlen(y->word);
+    if (lx != ly) return lx < ly ? -1 : 1;
+    return strcmp(x->word, y->word);
+}
+
+// keywords.txt 의 [언어] 이름과 keywords.h 의 매크로
+struct lang {
+    const char* name;
+    const char* macro;
+};
+
+const struct lang langs[] = {
+    { "c", "KW_LANG_C" },
+    { "cpp", "KW_LANG_CPP" },
+    { "python", "KW_LANG_PYTHON" },
+    { "sh", "KW_LANG_SH" },
+    { "make", "KW_LANG_MAKE" },
+};
+
+#define NLANGS (int)(sizeof(langs) / sizeof(langs[0]))
+
+// [c cpp] 같은 줄. 언어 비트를 돌려준다 (모르는 이름이면 -1)
+int parse_section(char* line) {
+    int mask = 0;
+    char* close = strchr(line, ']');
+    if (!close) return -1;
+    *close = '\0';
+    for (char* name = strtok(line + 1, " \t"); name; name = strtok(NULL, " \t")) {
+        int i = 0;
+        while (i < NLANGS && strcmp(name, langs[i].name) != 0) i++;
+        if (i == NLANGS) return -1;
+        mask |= 1 << i;
+    }
+    return mask ? mask : -1;
+}
+
+int parse(FILE* in, const char* path) {
+    char line[256];
+    int no = 0, section = 0;
+    while (fgets(line, sizeof(line), in)) {
+        no++;
+        char* p = strchr(line, '#');
+        if (p) *p = '\0';
+        p = line + strspn(line, " \t");
+        if (*p == '[') {
+            if ((section = parse_section(p)) < 0) {
+                fprintf(stderr, "%s:%d: bad language section\n", path, no);
+                return -1;
+            }
+            continue;
+        }
+
+        char* word = strtok(p, " \t\r\n");
+        if (!word) continue;
+        char* cls = strtok(NULL, " \t\r\n");
+        if (!cls || strtok(NULL, " \t\r\n") || strlen(word) >= sizeof(keywords[0].word) ||
+            strlen(cls) >= sizeof(keywords[0].cls) || count == MAX_KEYWORDS) {
+            fprintf(stderr, "%s:%d: bad keyword line\n", path, no);
+            return -1;
+        }
+        if (!section) {
+            fprintf(stderr, "%s:%d: keyword before any [language] section\n", path, no);
+            return -1;
+        }
+        for (char* c = word; *c; c++) {
+            if (!isalnum((unsigned char)*c) && *c != '_') {
+                fprintf(stderr, "%s:%d: bad keyword '%s'\n", path, no, word);
+                return -1;
+            }
+        }
+        if (strcmp(cls, "type") != 0 && strcmp(cls, "keyword") != 0) {
+            fprintf(stderr, "%s:%d: unknown class '%s'\n", path, no, cls);
+            return -1;
+        }
+
+        // 이미 다른 언어에 있는 단어면 분류가 같을 때 언어만 더한다
+        int merged = 0;
+        for (int i = 0; i < count && !merged; i++) {
+            struct keyword* k = &keywords[i];
+            if (strcmp(k->word, word) != 0) continue;
+            if (strcmp(k->cls, cls) == 0) {
+                k->langs |= section;
+                merged = 1;
+            } else if (k->langs & section) {
+                fprintf(stderr, "%s:%d: '%s' has two classes in one language\n", path, no, word);
+                return -1;
+            }
+        }
+        if (merged) continue;
+
+        struct keyword* k = &keywords[count++];
+        strcpy(k->word, word);
+        strcpy(k->cls, cls);
+        k->langs = section;
+    }
+    return 0;
+}
+
+// 언어 비트를 "KW_LANG_C | KW_LANG_CPP" 꼴로
+void lang_mask(int mask, char* out, size_t n) {
+    out[0] = '\0';
+    for (int i = 0; i < NLANGS; i++) {
+        if (!(mask & (1 << i))) continue;
+        size_t used = strlen(out);
+        snprintf(out + used, n - used, "%s%s", used ? " | " : "", langs[i].macro);
+    }
+}
+
+void emit(void) {
+    printf("// mkkeywords 가 keywords.txt 에서 만든 파일. 직접 고치지 말 것\n");
+    printf("#include <string.h>\n\n#include \"keywords.h\"\n\n");
+    printf("int keyword_class(const char* word, size_t len, int lang) {\n");
+    printf("    switch (len) {\n");
+    for (int i = 0; i < count;) {
+        size_t len = strlen(keywords[i].word);
+        printf("    case %zu:\n        switch (word[0]) {\n", len);
+        while (i < count && strlen(keywords[i].word) == len) {
+            char first = keywords[i].word[0];
+            printf("        case '%c':\n", first);
+            for (; i < count && strlen(keywords[i].word) == len && keywords[i].word[0] == first; i++) {
+                const struct keyword* k = &keywords[i];
+                char cls[32];
+                for (int j = 0; (cls[j] = toupper((unsigned char)k->cls[j])) != '\0'; j++);
+                // 첫 글자는 이미 맞으므로 나머지만 비교한다
+                char mask[256];
+                lang_mask(k->langs, mask, sizeof(mask));
+                printf("            if ((lang & (%s)) && memcmp(word + 1, \"%s\", %zu) == 0) return KW_%s;\n",
+                       mask, k->word + 1, len - 1, cls);
+            }
+            printf("            break;\n");
+        }
+        printf("        }\n        break;\n");
+    }
+    printf("    }\n    return KW_NONE;\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s keywords.txt\n", argv[0]);
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    int r = parse(in, argv[1]);
+    fclose(in);
+    if (r < 0) return 1;
+
+    qsort(keywords, count, sizeof(keywords[0]), compare);
+    emit();
+    return 0;
+}
@@ -8,9 +8,14 @@
 #include <ncurses.h>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <ctype.h>
 #include <limits.h>
+#include <errno.h>
+
+#include "keywords.h"
 
 //버퍼의 크기(필요에 따라 크기를 늘리거나 줄일 예정정)
 #define MAX_LINE_LEN 100
@@ -78,15 +83,6 @@ const char* file_menu[] = {"New", "Open", "Save", "Exit"};
 const char* build_menu[] = {"Run", "Link"};
 const char* option_menu[] = {"NUM", "SYN", "{ }"};
 
-const char* dataType[] = {"int", "unsigned", "signed", "double", "float",
-"char", "short", "long", "void"};
-const char* etc[] = {"sizeof", "typedef", "struct", "union", "enum", "extern", "static", "const"};
-const char* memoryKeyword[] = {"malloc", "free", "calloc", "realloc"};
-const char* controlKeyword[] = {"if", "else", "switch", "case", "default", "while", "for", "do", "continue", "break", "return"};
-
-const char* cyan_keyword[] = {"int", "double", "float", "enum", "char", "short", "long", "malloc", "free", "calloc", "realloc"};
-const char* magenta_keyword[] = {"void", "unsigned", "signed", "sizeof", "typedef", "struct", "union", "extern", "static", "const", "if", "else", "switch", "case", "default", "while", "for", "do", "continue", "break","return"};
-
 //프로그램 시작시 기본 설정 세팅
 void initProgram(){
     initscr();
@@ -148,92 +144,109 @@ void setWinSize() {
 	printScreen();
 }
 
+//버퍼 전체를 같은 디렉터리의 임시 파일에 한 번에 쓰고 fsync 후 rename으로 원본과 바꿔치기하는 함수
+//저장 도중 프로그램이 죽어도 원본 파일은 그대로 남는다. 실패하면 -1 (errno 유지)
+int writeFileAtomic(){
+    static char out[MAX_LINES * MAX_LINE_LEN];
+    char tmpName[PATH_MAX];
+    struct stat st;
+    int fd, len = 0, haveStat;
+
+    //버퍼에서 한 줄식 뒤에 '\n'을 붙여서 모아 둔다
+    for(int count = 0; count <= totalLines; count++){
+        int n = strlen(buffer[count]);
+        memcpy(out + len, buffer[count], n);
+        len += n;
+        out[len++] = '\n';
+    }
+
+    char* slash = strrchr(currentFileName, '/');
+    int dirLen = slash ? (int)(slash - currentFileName) + 1 : 0;
+    snprintf(tmpName, sizeof(tmpName), "%.*s.%s.XXXXXX", dirLen, currentFileName,
+             currentFileName + dirLen);
+    if((fd = mkstemp(tmpName)) == -1)
+        return -1;
+
+    //기존 파일의 권한과 소유자를 그대로 유지
+    haveStat = stat(currentFileName, &st) == 0;
+    fchmod(fd, haveStat ? (st.st_mode & 07777) : 0644);
+    if(haveStat && fchown(fd, st.st_uid, st.st_gid) == -1){}
+
+    int ok = write(fd, out, len) == len && fsync(fd) == 0;
+    if(close(fd) == -1)
+        ok = 0;
+    if(!ok || rename(tmpName, currentFileName) == -1){
+        int saved = errno;
+        unlink(tmpName);
+        errno = saved;
+        return -1;
+    }
+
+    //rename 결과가 디스크에 남도록 디렉터리도 fsync
+    char dirName[PATH_MAX];
+    snprintf(dirName, sizeof(dirName), "%.*s", dirLen ? dirLen : 1, dirLen ? currentFileName : ".");
+    if((fd = open(dirName, O_RDONLY)) != -1){
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
 void* saveFileThread(void* arg) {
-    //이건 과제에서 저장하는 부분만 떼 온 것.
-    int fd, count = 0;
-    
     pthread_mutex_lock(&mutex);
-    if((fd = creat(currentFileName, 0644)) == -1){
-        perror("create error!");
+    if(writeFileAtomic() == -1){
+        perror("save error!");
         pthread_mutex_unlock(&mutex);
         pthread_exit(NULL);
     }
-
-    while(count <= totalLines){
-        //버퍼에서 한 줄식 뒤에 '\n'을 붙여서 파일에 저장
-        copiedStr[0] = '\0';
-        strcpy(copiedStr, buffer[count]);
-        strcat(copiedStr, "\n\0");
-
-        if(write(fd, copiedStr, strlen(copiedStr)) != strlen(copiedStr)){
-            perror("wirte error!");
-            pthread_mutex_unlock(&mutex);
-            pthread_exit(NULL);
-        }
-        count++;
-    }
-    close(fd);
     pthread_mutex_unlock(&mutex);
     return NULL;
 }
 
 //현재 작성중인 파일을 저장하는 함수
 void saveFile(){
-    //이건 과제에서 저장하는 부분만 떼 온 것.
-    int fd, count = 0;
-    
     pthread_mutex_lock(&mutex);
-    if((fd = creat(currentFileName, 0644)) == -1){
-        perror("create error!");
+    if(writeFileAtomic() == -1){
+        perror("save error!");
         pthread_mutex_unlock(&mutex);
         exit(1);
     }
-
-    while(count <= totalLines){
-        //버퍼에서 한 줄식 뒤에 '\n'을 붙여서 파일에 저장
-        copiedStr[0] = '\0';
-        strcpy(copiedStr, buffer[count]);
-        strcat(copiedStr, "\n\0");
-
-        if(write(fd, copiedStr, strlen(copiedStr)) != strlen(copiedStr)){
-            perror("wirte error!");
-            pthread_mutex_unlock(&mutex);
-            exit(1);
-        }
-        count++;
-    }
-
-    close(fd);
     pthread_mutex_unlock(&mutex);
 }
 
 //기존의 파일을 append모드로 열어서 뒤에서부터 수정할 수 있도록 하는 함수
 void newFileOpen(char* filePath) {
     pthread_mutex_lock(&mutex);
-    int idx = 0;
     int cur_row = 0;
     
 	int fd = open(filePath, O_RDONLY);
 	if (fd == -1) {
 	    perror(filePath);
 	    exit(1);
-	} else {
-		ssize_t bytes;
-        char ch;
-     
-		while ((bytes = read(fd, &ch, 1)) > 0) {
-            if (ch == '\n' || idx >= MAX_LINE_LEN - 1) {
-                copiedStr[idx] = '\0';
-                strcpy(buffer[cur_row++], copiedStr);
-                idx = 0;
-            } else {
-                copiedStr[idx++] = ch;
-            }
+	}
+
+    //파일을 통째로 매핑해서 개행 단위로 잘라 담는다 (한 바이트씩 read 하지 않음)
+    struct stat st;
+    char* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map != MAP_FAILED) {
+        const char* p = map;
+        const char* end = map + st.st_size;
+        while (p < end && cur_row < MAX_LINES) {
+            const char* nl = memchr(p, '\n', end - p);
+            size_t len = (nl ? nl : end) - p;
+            //한 줄이 버퍼보다 길면 잘라서 다음 줄로 넘긴다
+            if (len > MAX_LINE_LEN - 1)
+                len = MAX_LINE_LEN - 1;
+            memcpy(buffer[cur_row], p, len);
+            buffer[cur_row++][len] = '\0';
+            p += len;
+            if (p < end && *p == '\n')
+                p++;
         }
-    }
-    if (idx > 0) {
-        copiedStr[idx] = '\0';
-        strcpy(buffer[cur_row++], copiedStr);
+        munmap(map, st.st_size);
     }
 
     totalLines = cur_row - 1;
@@ -319,6 +332,14 @@ void notification(char* message){
     pthread_mutex_unlock(&mutex);
 }
 
+// 찍을 수 없는 글자는 unctrl 표기의 첫 글자로 (탭은 공백)
+chtype cell(char c, chtype attr){
+    unsigned char u = c;
+    if (u == '\t') return ' ' | attr;
+    if (u < 32 || u >= 127) return (unsigned char)unctrl(u)[0] | attr;
+    return u | attr;
+}
+
 //문자의 입력, 지움, 줄바꿈 마다 그 업데이트된 내용을 출력
 void printScreen(){
     pthread_mutex_lock(&mutex);
@@ -333,20 +354,19 @@ void printScreen(){
 
     digit = cnt;
     start = digit + 1;
+    chtype cells[cols];
     for(int buffer_i = first; buffer_i < first + rows - 1; buffer_i++){
+        // 줄 전체를 색까지 붙여 모은 뒤 한 번에 출력
+        for (int k = 0; k < cols; k++) cells[k] = ' ';
         //make line number
-        move(screen_i, 0);
-        clrtoeol();
         if (buffer_i <= totalLines) {
             int tmp = buffer_i+1;
             for (int k = 0; k < digit; k++) {
-                mvaddch(screen_i, digit-k-1, 48 + tmp % 10);
+                cells[digit-k-1] = 48 + tmp % 10;
                 if (!(tmp / 10)) break;
                 else tmp /= 10;
             }
         }
-        move(screen_i, start);
-        clrtoeol();
 
         const char *line = buffer[buffer_i];
         int len = strlen(line);
@@ -358,45 +378,37 @@ void printScreen(){
         // " "안에 있는 문장 처리
         for(int j=0; j<len;){
             if(line[j] ==  '"' && !in_comment){
-                attron(COLOR_PAIR(2));
-                mvaddch(screen_i, x++, line[j++]);
+                cells[x++] = cell(line[j++], COLOR_PAIR(2));
                 while(j < len){
-                    mvaddch(screen_i, x++, line[j]);
+                    cells[x++] = cell(line[j], COLOR_PAIR(2));
                     if(line[j] == '"' && line[j-1] != '\\'){
                         j++;
                         break;
                     }
                     j++;
                 }
-                attroff(COLOR_PAIR(2));
                 continue;
             }
             
             // 한줄주석 (//...) 처리
             if(!in_string && !in_comment && j+1 < len && line[j] == '/' && line[j+1]== '/'){
-                attron(COLOR_PAIR(3));
                 while(j < len){
-                    mvaddch(screen_i, x++, line[j++]);
+                    cells[x++] = cell(line[j++], COLOR_PAIR(3));
                 }
-                attroff(COLOR_PAIR(3));
                 break;
             }
             
             // 전처리기 강조
             if(j==0 && line[j] == '#'){
-                attron(COLOR_PAIR(2));
                 while(j < len){
-                    mvaddch(screen_i, x++, line[j++]);
+                    cells[x++] = cell(line[j++], COLOR_PAIR(2));
                 }
-                attroff(COLOR_PAIR(2));
                 break;
             }
             
             //세미콜론 강조
             if(line[j] == ';'){
-                attron(COLOR_PAIR(4));
-                mvaddch(screen_i, x++, line[j++]);
-                attroff(COLOR_PAIR(4));
+                cells[x++] = cell(line[j++], COLOR_PAIR(4));
                 continue;
             }
 
@@ -410,26 +422,20 @@ void printScreen(){
                 word[k] = '\0';
                 
                 // CYAN 키워드 강조
-                if(is_cyan_keyword(word)){
-                    attron(COLOR_PAIR(1));
-                    mvprintw(screen_i, x, "%s", word);
-                    attroff(COLOR_PAIR(1));
-                }
+                chtype attr = 0;
+                if(is_cyan_keyword(word))
+                    attr = COLOR_PAIR(1);
                 // MAGENTA 키워드 강조
-                else if(is_magenta_keyword(word)){
-                    attron(COLOR_PAIR(5));
-                    mvprintw(screen_i, x, "%s", word);
-                    attroff(COLOR_PAIR(5));
-                }else{
-                    mvprintw(screen_i, x, "%s", word);
-                }
-
-                x += strlen(word);
+                else if(is_magenta_keyword(word))
+                    attr = COLOR_PAIR(5);
+                for (k = 0; word[k] && x < cols; k++)
+                    cells[x++] = cell(word[k], attr);
                 continue;
             }
 
-            mvaddch(screen_i, x++, line[j++]);
+            cells[x++] = cell(line[j++], 0);
         }
+        mvaddchnstr(screen_i, 0, cells, cols);
         screen_i++;
     }
     
@@ -444,18 +450,13 @@ void printScreen(){
     pthread_mutex_unlock(&mutex);
 }
 
+// 키워드 표는 keywords.txt 에서 만든 분류기를 main.c 와 함께 쓴다
 int is_cyan_keyword(const char* word){
-    for(int i=0; cyan_keyword[i] != NULL; i++){
-        if(strcmp(word, cyan_keyword[i]) == 0) return 1;
-    }
-    return 0;
+    return keyword_class(word, strlen(word), KW_LANG_C) == KW_TYPE;
 }
 
 int is_magenta_keyword(const char* word){
-    for(int i=0; magenta_keyword[i] != NULL; i++){
-        if(strcmp(word, magenta_keyword[i]) == 0) return 1;
-    }
-    return 0;
+    return keyword_class(word, strlen(word), KW_LANG_C) == KW_KEYWORD;
 }
 
 //현재의 buffer의 인덱스와 first를 비교해서 정확한 커서위치를 찾아주는 함수
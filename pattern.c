@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include <pthread.h>
+
+#include "pattern.h"
+
+struct pattern {
+    char* source;
+    int flags;
+    regex_t re;
+    int refs;                   // 캐시가 쥔 것 하나 + 빌려 간 수
+    unsigned long used;         // 마지막으로 꺼낸 순서 (가장 작은 것부터 밀려난다)
+};
+
+static pattern* cache[PATTERN_CACHE];
+static unsigned long clock_tick;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void drop(pattern* p) {
+    if (--p->refs > 0) return;
+    regfree(&p->re);
+    free(p->source);
+    free(p);
+}
+
+// source 를 새로 컴파일한다 (refs 1, 캐시 밖)
+static pattern* compile(const char* source, int flags, char* err, size_t errlen) {
+    pattern* p = calloc(1, sizeof(*p));
+    if (!p || !(p->source = strdup(source))) {
+        free(p);
+        if (errlen) snprintf(err, errlen, "out of memory");
+        return NULL;
+    }
+    int cflags = REG_EXTENDED | REG_NEWLINE | (flags & PATTERN_ICASE ? REG_ICASE : 0);
+    int rc = regcomp(&p->re, source, cflags);
+    if (rc != 0) {
+        if (errlen) regerror(rc, &p->re, err, errlen);
+        free(p->source);
+        free(p);
+        return NULL;
+    }
+    p->flags = flags;
+    p->refs = 1;
+    return p;
+}
+
+// 캐시에서 같은 식을 찾아 빌려 준다. 없으면 NULL 이고 *slot 에 넣을 자리를 담는다
+// (빈 칸이 있으면 거기, 없으면 가장 오래 안 쓴 것 자리). cache_lock 을 쥐고 부를 것
+static pattern* lookup(const char* source, int flags, int* slot) {
+    *slot = 0;
+    for (int i = 0; i < PATTERN_CACHE; i++) {
+        pattern* c = cache[i];
+        if (c && c->flags == flags && strcmp(c->source, source) == 0) {
+            c->used = ++clock_tick;
+            c->refs++;
+            return c;
+        }
+        if (!c || (cache[*slot] && c->used < cache[*slot]->used)) *slot = i;
+    }
+    return NULL;
+}
+
+pattern* pattern_get(const char* source, int flags, char* err, size_t errlen) {
+    int slot;
+    pthread_mutex_lock(&cache_lock);
+    pattern* c = lookup(source, flags, &slot);
+    pthread_mutex_unlock(&cache_lock);
+    if (c) return c;
+
+    // 컴파일은 잠금 밖에서 한다. 그 사이 다른 스레드가 같은 식을 넣었으면 그것을 쓰고 새로 만든 것은 버린다
+    pattern* p = compile(source, flags, err, errlen);
+    if (!p) return NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    if ((c = lookup(source, flags, &slot)) != NULL) {
+        drop(p);
+        pthread_mutex_unlock(&cache_lock);
+        return c;
+    }
+    p->refs = 2;                // 캐시 하나, 돌려주는 것 하나
+    p->used = ++clock_tick;
+    if (cache[slot]) drop(cache[slot]);
+    cache[slot] = p;
+    pthread_mutex_unlock(&cache_lock);
+    return p;
+}
+
+pattern* pattern_clone(const pattern* p) {
+    return compile(p->source, p->flags, NULL, 0);
+}
+
+void pattern_retain(pattern* p) {
+    pthread_mutex_lock(&cache_lock);
+    p->refs++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void pattern_release(pattern* p) {
+    if (!p) return;
+    pthread_mutex_lock(&cache_lock);
+    drop(p);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+const char* pattern_source(const pattern* p) {
+    return p->source;
+}
+
+int pattern_exec(pattern* p, const char* data, size_t from, size_t to, struct pattern_match* m) {
+    regmatch_t g[PATTERN_GROUPS];
+    g[0].rm_so = from;
+    g[0].rm_eo = to;
+    int eflags = REG_STARTEND;
+    if (from > 0 && data[from - 1] != '\n') eflags |= REG_NOTBOL;
+    if (regexec(&p->re, data, PATTERN_GROUPS, g, eflags) != 0) return 0;
+    for (int i = 0; i < PATTERN_GROUPS; i++) {
+        m->start[i] = g[i].rm_so;
+        m->end[i] = g[i].rm_eo;
+    }
+    return 1;
+}
+
+size_t pattern_expand(const char* repl, size_t rlen, const char* data, const struct pattern_match* m, char* out) {
+    size_t n = 0;
+    for (size_t i = 0; i < rlen; i++) {
+        char c = repl[i];
+        if (c == '\\' && i + 1 < rlen) {
+            char d = repl[++i];
+            if (d >= '0' && d <= '9') {
+                int k = d - '0';
+                if (m->start[k] >= 0) {
+                    size_t len = m->end[k] - m->start[k];
+                    if (out) memcpy(out + n, data + m->start[k], len);
+                    n += len;
+                }
+                continue;
+            }
+            c = d;
+        }
+        if (out) out[n] = c;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,40 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stddef.h>
+
+// 정규식 (POSIX 확장 정규식, 줄 단위: '.' 과 [^...] 는 개행을 넘지 않고 ^ $ 는 줄 경계에 맞는다)
+// 컴파일한 패턴은 최근에 쓴 PATTERN_CACHE 개까지 캐시해 두었다가 같은 식이 오면 다시 쓴다.
+typedef struct pattern pattern;
+
+#define PATTERN_CACHE 16
+#define PATTERN_GROUPS 10       // \0 (일치 전체) 과 묶음 \1..\9
+
+// 플래그
+#define PATTERN_ICASE 1         // 대소문자 무시
+
+// 일치한 구간. 참여하지 않은 묶음은 start 가 -1
+struct pattern_match {
+    long start[PATTERN_GROUPS];
+    long end[PATTERN_GROUPS];
+};
+
+// source 를 컴파일한 패턴 (캐시에 있으면 그것). 다 쓰면 pattern_release 로 놓는다
+// 식이 틀렸으면 NULL 이고 err 에 까닭을 담는다
+pattern* pattern_get(const char* source, int flags, char* err, size_t errlen);
+// 같은 식을 따로 컴파일한 사본 (캐시에 넣지 않는다). regexec 은 패턴마다 잠금을 잡으므로
+// 여러 스레드가 같은 식으로 동시에 찾을 때는 스레드마다 사본을 쓴다. 실패 시 NULL
+pattern* pattern_clone(const pattern* p);
+void pattern_retain(pattern* p);
+void pattern_release(pattern* p);
+const char* pattern_source(const pattern* p);
+
+// data[from, to) 에서 첫 일치를 찾아 m 에 data 기준 위치로 담는다. 찾으면 1
+// from 이 줄 처음이 아니면(data[from - 1] 이 개행이 아니면) ^ 는 from 에 맞지 않는다
+int pattern_exec(pattern* p, const char* data, size_t from, size_t to, struct pattern_match* m);
+
+// 바꿀 글 repl[0, rlen) 을 펼친다. \0..\9 는 묶음, \\ 는 역슬래시 한 글자
+// out 이 NULL 이 아니면 거기에 쓰고, 펼친 길이를 돌려준다
+size_t pattern_expand(const char* repl, size_t rlen, const char* data, const struct pattern_match* m, char* out);
+
+#endif
@@ -0,0 +1,743 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SEARCH_SSE2 1
+#endif
+
+#include "search.h"
+#include "pattern.h"
+
+// 한 번에 읽어 훑는 블록 크기
+#define SEARCH_BLOCK (256 * 1024)
+// 이보다 긴 문서는 SEARCH_CHUNK 조각으로 나눠 코어 수만큼의 스레드가 함께 훑는다
+#define SEARCH_PARALLEL_MIN (4 * 1024 * 1024)
+#define SEARCH_CHUNK (1024 * 1024)
+#define SEARCH_THREADS_MAX 64
+
+// 조각 하나의 결과
+struct chunk {
+    int state;                  // 0 훑는 중, 1 끝남, -1 실패
+    size_t* matches;
+    long count, cap;
+};
+
+// 스레드들이 조각을 하나씩 가져가 훑는 일. 검색을 새로 시작하거나 좁히면 버리고 새로 만든다
+struct job {
+    int refs;                   // 검색이 쥔 것 하나 + 조각을 훑고 있는 스레드 수 (lock 으로 지킨다)
+    unsigned long id;
+    // 스레드마다 따로 읽는 스냅숏 (읽기도 스냅숏 안의 조각 위치 캐시를 고치므로 나눠 쓰지 않는다)
+    document* snap[SEARCH_THREADS_MAX];
+    char* query;
+    size_t len;
+    pattern* re;
+    size_t from, length;        // [from, length) 를 from 부터 SEARCH_CHUNK 씩 나눈다
+    long nchunks, next;         // next: 다음에 가져갈 조각
+    struct chunk* chunks;
+};
+
+struct worker {
+    struct search* s;
+    int id;
+    pthread_t thread;
+};
+
+struct search {
+    document* snap;             // 검색을 시작할 때의 문서 스냅샷. NULL 이면 검색 중이 아님
+    unsigned long version;
+    char* query;
+    size_t len;
+    pattern* re;                // 정규식으로 찾는 중이면 그 패턴 (query 는 그 원문)
+    size_t pos;                 // 다음 블록이 시작할 위치 (여기보다 앞에서 시작하는 결과는 모두 찾음)
+    size_t length;              // 문서 길이
+    int done;
+
+    size_t* matches;            // 찾은 위치 (오름차순)
+    long count, cap;            // [0, count) 가 지금 검색어로 확인된 결과
+    // 좁히는 중이면 [pending, pending_end) 가 앞 검색어의 결과로 아직 확인하지 않은 후보
+    // (모두 pos 앞에 있고, 다 확인한 뒤에야 pos 부터 이어서 훑는다)
+    long pending, pending_end;
+    size_t base, got;           // 후보를 확인하려고 block 에 읽어 둔 구간 [base, base + got)
+
+    char* block;                // 블록 읽기 버퍼 (블록 + 찾는 문자열 길이)
+    size_t block_cap;
+
+    // 큰 문서는 스레드들이 조각을 나눠 훑고, search_step 은 앞 조각부터 끝난 결과를 색인에 옮긴다
+    int parallel;               // 이번 검색은 스레드들이 훑는다
+    struct job* job;            // 지금 훑는 일. 아직 시작하지 않았으면 NULL
+    long collected;             // job 의 조각 중 결과를 색인에 옮긴 수
+    unsigned long jobs;
+    struct worker workers[SEARCH_THREADS_MAX];  // 처음 나눠 훑을 때 띄운다
+    int nworkers, stop;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // 새 일이 왔다
+    pthread_cond_t finished;    // 조각 하나를 다 훑었다
+};
+
+// data[from, to) 안에 needle[0, m) 이 통째로 들어 있는 첫 시작 위치. 없으면 to
+static size_t find_scalar(const char* data, size_t from, size_t to, const char* needle, size_t m) {
+    const char* p = data + from;
+    const char* end = data + to;
+    while (end - p >= (long)m && (p = memchr(p, needle[0], end - p - m + 1)) != NULL) {
+        if (memcmp(p + 1, needle + 1, m - 1) == 0) return p - data;
+        p++;
+    }
+    return to;
+}
+
+#ifdef SEARCH_SSE2
+// 첫 글자와 마지막 글자가 함께 맞는 자리를 16바이트씩 골라낸 뒤 그 자리만 비교한다
+static size_t find_sse2(const char* data, size_t from, size_t to, const char* needle, size_t m) {
+    if (m < 2) return find_scalar(data, from, to, needle, m);
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = from;
+    for (; i + m - 1 + 16 <= to; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(data + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            size_t p = i + __builtin_ctz(mask);
+            if (memcmp(data + p + 1, needle + 1, m - 2) == 0) return p;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data, i, to, needle, m);
+}
+#define find find_sse2
+#else
+#define find find_scalar
+#endif
+
+search* search_new(void) {
+    search* s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->done = 1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->finished, NULL);
+    return s;
+}
+
+// lock 을 쥐고 부를 것
+static void job_release(struct job* j) {
+    if (--j->refs > 0) return;
+    for (int k = 0; k < SEARCH_THREADS_MAX; k++)
+        if (j->snap[k]) doc_free(j->snap[k]);
+    for (long i = 0; i < j->nchunks; i++) free(j->chunks[i].matches);
+    free(j->chunks);
+    free(j->query);
+    pattern_release(j->re);
+    free(j);
+}
+
+// 훑던 일을 버린다. 조각을 훑고 있던 스레드는 그 조각만 마치고 손을 뗀다
+static void cancel_job(search* s) {
+    pthread_mutex_lock(&s->lock);
+    if (s->job) job_release(s->job);
+    s->job = NULL;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void search_clear(search* s) {
+    cancel_job(s);
+    s->parallel = 0;
+    if (s->snap) doc_free(s->snap);
+    s->snap = NULL;
+    pattern_release(s->re);
+    s->re = NULL;
+    s->count = 0;
+    s->pending = s->pending_end = 0;
+    s->done = 1;
+}
+
+void search_free(search* s) {
+    if (!s) return;
+    search_clear(s);
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    for (int k = 0; k < s->nworkers; k++) pthread_join(s->workers[k].thread, NULL);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->finished);
+    free(s->query);
+    free(s->matches);
+    free(s->block);
+    free(s);
+}
+
+// 나눠 훑을 스레드 수 (코어 수)
+static int worker_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > SEARCH_THREADS_MAX ? SEARCH_THREADS_MAX : (int)n;
+}
+
+// 이번 검색을 스레드들에게 나눌지 정한다
+static void plan_parallel(search* s) {
+    s->parallel = s->length >= SEARCH_PARALLEL_MIN && worker_count() > 1;
+}
+
+// 검색어와 블록 버퍼를 query 에 맞춘다
+static int set_query(search* s, const char* query, size_t len) {
+    char* q = realloc(s->query, len + 1);
+    if (!q) return -1;
+    memcpy(q, query, len);
+    q[len] = '\0';
+    s->query = q;
+    s->len = len;
+
+    if (s->block_cap < SEARCH_BLOCK + len) {
+        char* b = realloc(s->block, SEARCH_BLOCK + len);
+        if (!b) return -1;
+        s->block = b;
+        s->block_cap = SEARCH_BLOCK + len;
+    }
+    return 0;
+}
+
+int search_start(search* s, document* doc, const char* query, size_t len) {
+    search_clear(s);
+    if (len == 0 || set_query(s, query, len) < 0) return -1;
+    s->snap = doc_snapshot(doc);
+    if (!s->snap) return -1;
+    s->version = doc_version(doc);
+    s->length = doc_length(s->snap);
+    s->pos = 0;
+    s->done = s->length < len;
+    plan_parallel(s);
+    return 0;
+}
+
+int search_start_pattern(search* s, document* doc, pattern* p) {
+    pattern_retain(p);          // 지금 쥔 패턴으로 다시 시작해도 놓치지 않게 먼저 쥔다
+    search_clear(s);
+    s->re = p;
+    const char* source = pattern_source(p);
+    if (set_query(s, source, strlen(source)) < 0 || !(s->snap = doc_snapshot(doc))) {
+        search_clear(s);
+        return -1;
+    }
+    s->version = doc_version(doc);
+    s->length = doc_length(s->snap);
+    s->pos = 0;
+    s->done = s->length == 0;
+    plan_parallel(s);
+    return 0;
+}
+
+int search_refine(search* s, document* doc, const char* query, size_t len) {
+    if (!s->snap || s->re || s->version != doc_version(doc) || len <= s->len || memcmp(query, s->query, s->len) != 0)
+        return search_start(s, doc, query, len);
+    if (set_query(s, query, len) < 0) {
+        search_clear(s);
+        return -1;
+    }
+    // 아직 색인에 옮기지 않은 조각 결과는 버리고, 나머지는 후보를 다 확인한 뒤 새 검색어로 다시 나눠 훑는다
+    cancel_job(s);
+    // 확인한 결과와 아직 확인하지 못한 후보를 모두 새 검색어의 후보로 돌린다.
+    // 실제 확인은 search_step 이 조금씩 한다
+    long left = s->pending_end - s->pending;
+    if (left > 0 && s->pending > s->count)
+        memmove(s->matches + s->count, s->matches + s->pending, left * sizeof(*s->matches));
+    s->pending = 0;
+    s->pending_end = s->count + left;
+    s->count = 0;
+    s->got = 0;
+    return 0;
+}
+
+int search_active(search* s) {
+    return s->snap != NULL;
+}
+
+// 결과 배열 *v 를 need 개 이상 담을 수 있게 늘린다
+static int grow(size_t** v, long* cap, long need) {
+    if (need <= *cap) return 0;
+    long c = *cap ? *cap : 256;
+    while (c < need) c *= 2;
+    size_t* p = realloc(*v, c * sizeof(*p));
+    if (!p) return -1;
+    *v = p;
+    *cap = c;
+    return 0;
+}
+
+static int add_match(search* s, size_t off) {
+    if (grow(&s->matches, &s->cap, s->count + 1) < 0) return -1;
+    s->matches[s->count++] = off;
+    return 0;
+}
+
+static int add_chunk_match(struct chunk* c, size_t off) {
+    if (grow(&c->matches, &c->cap, c->count + 1) < 0) return -1;
+    c->matches[c->count++] = off;
+    return 0;
+}
+
+// 후보를 앞에서부터 확인해 맞는 것만 결과로 남긴다. 후보가 촘촘하면 블록째 읽고, 멀면 그 자리만 읽는다
+static void check_pending(search* s, size_t* limit) {
+    while (s->pending < s->pending_end && *limit > 0) {
+        size_t off = s->matches[s->pending];
+        if (off + s->len > s->length) {
+            s->pending = s->pending_end;
+            break;
+        }
+        if (off < s->base || off + s->len > s->base + s->got) {
+            size_t want = s->len;
+            if (s->pending + 1 < s->pending_end && s->matches[s->pending + 1] < off + SEARCH_BLOCK)
+                want = SEARCH_BLOCK + s->len;
+            s->base = off;
+            s->got = doc_read(s->snap, off, s->block, want);
+            *limit = *limit > s->got ? *limit - s->got : 0;
+        }
+        if (memcmp(s->block + (off - s->base), s->query, s->len) == 0) s->matches[s->count++] = off;
+        s->pending++;
+        *limit = *limit > s->len ? *limit - s->len : 0;
+    }
+    if (s->pending == s->pending_end) {
+        s->pending = s->pending_end = 0;
+        s->got = 0;
+        if (s->pos + s->len > s->length) s->done = 1;
+    }
+}
+
+// doc 의 pos 부터 want 바이트를 *block 에 읽어 마지막 줄 끝에서 자른다. 그 안에 줄 끝이 없으면 그 줄이 끝날 때까지만
+// 더 읽는다 (그래서 pos + want 뒤에서 시작하는 줄은 들어가지 않는다). 정규식 결과는 줄을 넘지 않으므로 블록 경계에
+// 걸치지 않는다. 읽은 뒤에 0 을 붙여 둔다 (regexec 은 C 문자열을 받는다). 자른 길이를 돌려주고 실패 시 (size_t)-1
+static size_t read_lines(document* doc, size_t pos, size_t want, size_t length, char** block, size_t* cap) {
+    size_t n = 0;
+    for (;;) {
+        if (want > length - pos) want = length - pos;
+        if (want + 1 > *cap) {
+            char* b = realloc(*block, want + 1);
+            if (!b) return (size_t)-1;
+            *block = b;
+            *cap = want + 1;
+        }
+        size_t from = n;
+        n += doc_read(doc, pos + n, *block + n, want - n);
+        (*block)[n] = '\0';
+        if (pos + n >= length && from == 0) return n;
+        if (from == 0) {
+            for (size_t i = n; i > 0; i--)
+                if ((*block)[i - 1] == '\n') return i;
+        } else {
+            const char* nl = memchr(*block + from, '\n', n - from);
+            if (nl) return nl - *block + 1;
+        }
+        if (pos + n >= length) return n;
+        want *= 2;
+    }
+}
+
+// block[from, n) 에서 다음 정규식 결과. 블록 끝(다음 줄 처음)의 빈 결과는 다음 블록에서 찾는다
+static int next_pattern(pattern* re, const char* block, size_t from, size_t n, int last, struct pattern_match* m) {
+    if (from > n || !pattern_exec(re, block, from, n, m)) return 0;
+    return (size_t)m->start[0] < n || last;
+}
+
+// 조각 [cs, ce) 에서 시작하는 줄들을 정규식으로 훑는다 (조각 앞에서 시작한 줄은 앞 조각 몫이다)
+static int scan_chunk_pattern(struct job* j, document* snap, pattern* re, size_t cs, size_t ce,
+                              char** block, size_t* cap, struct chunk* c) {
+    size_t pos = cs;
+    if (pos > 0) {
+        // 조각 안에서 시작하는 첫 줄을 찾는다 (cs - 1 부터 첫 개행 뒤)
+        if (*cap < 4096) {
+            char* b = realloc(*block, 4096);
+            if (!b) return -1;
+            *block = b;
+            *cap = 4096;
+        }
+        for (size_t at = cs - 1;;) {
+            if (at >= ce - 1) return 0;     // 조각 안에서 시작하는 줄이 없다
+            size_t got = doc_read(snap, at, *block, ce - 1 - at < 4096 ? ce - 1 - at : 4096);
+            const char* nl = memchr(*block, '\n', got);
+            if (nl) {
+                pos = at + (nl - *block) + 1;
+                break;
+            }
+            at += got;
+        }
+    }
+    while (pos < ce) {
+        size_t want = ce - pos < SEARCH_BLOCK ? ce - pos : SEARCH_BLOCK;
+        size_t n = read_lines(snap, pos, want, j->length, block, cap);
+        if (n == (size_t)-1) return -1;
+        int last = pos + n >= j->length;
+        struct pattern_match m;
+        for (size_t i = 0; next_pattern(re, *block, i, n, last, &m);) {
+            if (add_chunk_match(c, pos + m.start[0]) < 0) return -1;
+            i = m.end[0] > m.start[0] ? (size_t)m.end[0] : (size_t)m.start[0] + 1;
+        }
+        pos += n;
+    }
+    return 0;
+}
+
+// 조각 [cs, ce) 에서 시작하는 결과를 찾는다. 경계에 걸친 결과를 위해 m - 1 바이트 더 읽는다
+static int scan_chunk_literal(struct job* j, document* snap, size_t cs, size_t ce, char** block, size_t* cap,
+                              struct chunk* c) {
+    size_t want = ce - cs + j->len - 1;
+    if (want > j->length - cs) want = j->length - cs;
+    if (want > *cap) {
+        char* b = realloc(*block, want);
+        if (!b) return -1;
+        *block = b;
+        *cap = want;
+    }
+    size_t got = doc_read(snap, cs, *block, want);
+    for (size_t i = 0;;) {
+        size_t p = find(*block, i, got, j->query, j->len);
+        if (p >= ce - cs || p >= got) break;
+        if (add_chunk_match(c, cs + p) < 0) return -1;
+        i = p + 1;
+    }
+    return 0;
+}
+
+// 나눠 훑는 스레드. 지금 일에서 조각을 하나씩 가져가 훑고 결과를 조각 자리에 둔다
+static void* search_worker(void* arg) {
+    struct worker* w = arg;
+    search* s = w->s;
+    char* block = NULL;
+    size_t cap = 0;
+    // regexec 은 패턴마다 잠금을 잡으므로 스레드마다 따로 컴파일한 사본을 쓴다
+    pattern* re = NULL;
+    unsigned long re_job = 0;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->stop) {
+        struct job* j = s->job;
+        if (!j || j->next == j->nchunks) {
+            pthread_cond_wait(&s->work, &s->lock);
+            continue;
+        }
+        long i = j->next++;
+        j->refs++;
+        pthread_mutex_unlock(&s->lock);
+
+        if (j->re && re_job != j->id) {
+            pattern_release(re);
+            re = pattern_clone(j->re);
+            re_job = j->id;
+        }
+        struct chunk c = { 0 };
+        size_t cs = j->from + (size_t)i * SEARCH_CHUNK;
+        size_t ce = j->length - cs > SEARCH_CHUNK ? cs + SEARCH_CHUNK : j->length;
+        int rc;
+        if (!j->re) rc = scan_chunk_literal(j, j->snap[w->id], cs, ce, &block, &cap, &c);
+        else rc = re ? scan_chunk_pattern(j, j->snap[w->id], re, cs, ce, &block, &cap, &c) : -1;
+        c.state = rc < 0 ? -1 : 1;
+
+        pthread_mutex_lock(&s->lock);
+        j->chunks[i] = c;
+        pthread_cond_broadcast(&s->finished);
+        job_release(j);
+    }
+    pthread_mutex_unlock(&s->lock);
+    pattern_release(re);
+    free(block);
+    return NULL;
+}
+
+static int start_workers(search* s) {
+    int n = worker_count();
+    while (s->nworkers < n) {
+        struct worker* w = &s->workers[s->nworkers];
+        w->s = s;
+        w->id = s->nworkers;
+        if (pthread_create(&w->thread, NULL, search_worker, w) != 0) break;
+        s->nworkers++;
+    }
+    return s->nworkers > 1 ? 0 : -1;
+}
+
+// pos 부터 끝까지를 조각으로 나눠 스레드들에게 맡긴다
+static int start_job(search* s) {
+    if (start_workers(s) < 0) return -1;
+    struct job* j = calloc(1, sizeof(*j));
+    if (!j) return -1;
+    j->refs = 1;
+    j->id = ++s->jobs;
+    j->from = s->pos;
+    j->length = s->length;
+    j->nchunks = (j->length - j->from + SEARCH_CHUNK - 1) / SEARCH_CHUNK;
+    j->chunks = calloc(j->nchunks ? j->nchunks : 1, sizeof(*j->chunks));
+    j->query = malloc(s->len + 1);
+    int ok = j->chunks && j->query;
+    if (ok) memcpy(j->query, s->query, s->len + 1);
+    j->len = s->len;
+    if (s->re) pattern_retain(j->re = s->re);
+    for (int k = 0; ok && k < s->nworkers; k++) ok = (j->snap[k] = doc_snapshot(s->snap)) != NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if (ok) {
+        s->job = j;
+        s->collected = 0;
+        pthread_cond_broadcast(&s->work);
+    } else {
+        job_release(j);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok ? 0 : -1;
+}
+
+// 앞 조각부터 다 훑은 것들의 결과를 색인에 옮긴다. 옮길 것이 하나도 없으면 다음 조각이 끝날 때까지 기다린다
+static int step_parallel(search* s, size_t limit) {
+    if (!s->job && start_job(s) < 0) {
+        s->parallel = 0;        // 스레드를 못 띄웠으면 혼자 훑는다
+        return 0;
+    }
+    struct job* j = s->job;
+    int moved = 0, rc = 0;
+    pthread_mutex_lock(&s->lock);
+    while (s->collected < j->nchunks && limit > 0) {
+        struct chunk* c = &j->chunks[s->collected];
+        if (c->state == 0) {
+            if (moved) break;
+            pthread_cond_wait(&s->finished, &s->lock);
+            continue;
+        }
+        if (c->state < 0 || grow(&s->matches, &s->cap, s->count + c->count) < 0) {
+            rc = -1;
+            break;
+        }
+        memcpy(s->matches + s->count, c->matches, c->count * sizeof(*c->matches));
+        s->count += c->count;
+        free(c->matches);
+        c->matches = NULL;
+        s->collected++;
+        s->pos = j->length - j->from > (size_t)s->collected * SEARCH_CHUNK ? j->from + (size_t)s->collected * SEARCH_CHUNK
+                                                                          : j->length;
+        limit = limit > SEARCH_CHUNK ? limit - SEARCH_CHUNK : 0;
+        moved = 1;
+    }
+    int finished = s->collected == j->nchunks;
+    pthread_mutex_unlock(&s->lock);
+    if (rc < 0) return -1;
+    if (finished) {
+        s->pos = s->length;
+        s->done = 1;
+        cancel_job(s);
+    }
+    return search_done(s);
+}
+
+static int step_pattern(search* s, size_t limit) {
+    while (!s->done && limit > 0) {
+        size_t n = read_lines(s->snap, s->pos, SEARCH_BLOCK, s->length, &s->block, &s->block_cap);
+        if (n == (size_t)-1) return -1;
+        int last = s->pos + n >= s->length;
+        struct pattern_match m;
+        for (size_t i = 0; next_pattern(s->re, s->block, i, n, last, &m);) {
+            if (add_match(s, s->pos + m.start[0]) < 0) return -1;
+            i = m.end[0] > m.start[0] ? (size_t)m.end[0] : (size_t)m.start[0] + 1;
+        }
+        s->pos += n;
+        if (last) s->done = 1;
+        limit = limit > n ? limit - n : 0;
+    }
+    return search_done(s);
+}
+
+int search_step(search* s, size_t limit) {
+    if (!s->re) check_pending(s, &limit);
+    if (s->parallel && !s->done && s->pending == s->pending_end && limit > 0) {
+        int rc = step_parallel(s, limit);
+        if (s->parallel) return rc;
+    }
+    if (s->re) return step_pattern(s, limit);
+    while (!s->done && s->pending == s->pending_end && limit > 0) {
+        // 이번 블록에서는 [pos, pos + n) 에서 시작하는 결과를 찾는다. 경계에 걸친 결과를 위해 m - 1 바이트 더 읽는다
+        size_t n = s->length - s->pos;
+        if (n > SEARCH_BLOCK) n = SEARCH_BLOCK;
+        size_t want = n + s->len - 1;
+        if (want > s->length - s->pos) want = s->length - s->pos;
+        size_t got = doc_read(s->snap, s->pos, s->block, want);
+
+        size_t i = 0;
+        for (;;) {
+            size_t p = find(s->block, i, got, s->query, s->len);
+            if (p >= n || p >= got) break;
+            if (add_match(s, s->pos + p) < 0) return -1;
+            i = p + 1;
+        }
+        s->pos += n;
+        if (s->pos + s->len > s->length) s->done = 1;
+        limit = limit > n ? limit - n : 0;
+    }
+    return search_done(s);
+}
+
+int search_done(search* s) {
+    return s->done && s->pending == s->pending_end;
+}
+
+// 이 위치 앞의 결과는 모두 확인되었다
+static size_t scanned(search* s) {
+    return s->pending < s->pending_end ? s->matches[s->pending] : s->done ? s->length : s->pos;
+}
+
+long search_count(search* s) {
+    return s->count;
+}
+
+size_t search_match(search* s, long i) {
+    return s->matches[i];
+}
+
+size_t search_length(search* s) {
+    return s->len;
+}
+
+const char* search_query(search* s) {
+    return s->query ? s->query : "";
+}
+
+unsigned long search_version(search* s) {
+    return s->version;
+}
+
+long search_find(search* s, size_t off) {
+    long lo = 0, hi = s->count;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (s->matches[mid] < off) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+long search_next(search* s, size_t off) {
+    if (!s->snap) return -1;
+    long i = search_find(s, off);
+    while (i == s->count && !search_done(s)) {
+        if (search_step(s, SEARCH_BLOCK) < 0) break;
+        i = search_find(s, off);
+    }
+    if (i < s->count) return i;
+    return s->count > 0 ? 0 : -1;
+}
+
+long search_prev(search* s, size_t off) {
+    if (!s->snap) return -1;
+    // off 앞은 모두 훑어야 바로 앞 결과를 안다
+    while (!search_done(s) && scanned(s) < off && search_step(s, SEARCH_BLOCK) >= 0) {
+    }
+    long i = search_find(s, off);
+    if (i > 0) return i - 1;
+    // 처음으로 돌아가야 하면 끝까지 훑어 마지막 결과를 준다
+    while (!search_done(s) && search_step(s, (size_t)-1) >= 0) {
+    }
+    return s->count > 0 ? s->count - 1 : -1;
+}
+
+int search_is_pattern(search* s) {
+    return s->re != NULL;
+}
+
+pattern* search_pattern(search* s) {
+    return s->re;
+}
+
+size_t search_find_in(search* s, const char* data, size_t from, size_t to, size_t* len) {
+    if (s->re) {
+        struct pattern_match m;
+        if (from > to || !pattern_exec(s->re, data, from, to, &m)) return to;
+        *len = m.end[0] - m.start[0];
+        return m.start[0];
+    }
+    *len = s->len;
+    return search_find_literal(data, from, to, s->query, s->len);
+}
+
+size_t search_find_literal(const char* data, size_t from, size_t to, const char* query, size_t len) {
+    if (len == 0 || from > to) return to;
+    return find(data, from, to, query, len);
+}
+
+// out 을 need 바이트 이상으로 늘린다
+static int reserve(char** out, size_t* cap, size_t need) {
+    if (*out && need <= *cap) return 0;
+    size_t c = *cap ? *cap : 4096;
+    while (c < need) c *= 2;
+    char* p = realloc(*out, c);
+    if (!p) return -1;
+    *out = p;
+    *cap = c;
+    return 0;
+}
+
+long search_replace_all(search* s, document* doc, const char* repl, size_t rlen) {
+    if (!s->re && s->len == 0) return -1;
+    size_t length = doc_length(doc);
+    char* out = NULL;
+    size_t out_len = 0, out_cap = 0;
+    size_t first = 0, last = 0, keep = 0;   // 바뀌는 구간 [first, last) 과 그 구간을 바꾼 글 out[0, keep)
+    size_t cur = 0;                         // 여기까지의 원문은 out 에 옮겼다
+    long count = 0;
+
+    // 결과를 앞에서부터 겹치지 않게 고르며, 첫 결과부터는 사이 원문과 바꿀 글을 out 에 이어 붙인다
+    for (size_t pos = 0; pos < length;) {
+        size_t n = read_lines(doc, pos, SEARCH_BLOCK, length, &s->block, &s->block_cap);
+        if (n == (size_t)-1) goto fail;
+        int end = pos + n >= length;
+        size_t i = 0;
+        for (;;) {
+            size_t a, b, rep;
+            struct pattern_match m;
+            if (s->re) {
+                if (!next_pattern(s->re, s->block, i, n, end, &m)) break;
+                a = m.start[0];
+                b = m.end[0];
+                rep = pattern_expand(repl, rlen, s->block, &m, NULL);
+            } else {
+                a = find(s->block, i, n, s->query, s->len);
+                if (a >= n) break;
+                b = a + s->len;
+                rep = rlen;
+            }
+            if (count++ == 0) first = cur = pos + a;
+            if (reserve(&out, &out_cap, out_len + (pos + a - cur) + rep) < 0) goto fail;
+            memcpy(out + out_len, s->block + (cur - pos), pos + a - cur);
+            out_len += pos + a - cur;
+            if (s->re) pattern_expand(repl, rlen, s->block, &m, out + out_len);
+            else memcpy(out + out_len, repl, rlen);
+            out_len += rep;
+            cur = last = pos + b;
+            keep = out_len;
+            i = b > a ? b : a + 1;
+        }
+        // 뒤에 결과가 더 있을지 모르니 블록의 남은 원문도 옮겨 둔다 (마지막 결과 뒤는 나중에 잘라 낸다)
+        if (count > 0 && cur < pos + n) {
+            if (reserve(&out, &out_cap, out_len + (pos + n - cur)) < 0) goto fail;
+            memcpy(out + out_len, s->block + (cur - pos), pos + n - cur);
+            out_len += pos + n - cur;
+            cur = pos + n;
+        }
+        pos += n;
+    }
+
+    // 한 번의 삽입과 한 번의 삭제로 바꾼다. 삭제가 실패하면 넣은 것을 도로 지운다
+    if (count > 0) {
+        if (doc_insert(doc, first, out, keep) < 0) goto fail;
+        if (doc_delete(doc, first + keep, last - first) < 0) {
+            doc_delete(doc, first, keep);
+            goto fail;
+        }
+    }
+    free(out);
+    search_clear(s);
+    return count;
+
+fail:
+    free(out);
+    search_clear(s);
+    return -1;
+}
@@ -0,0 +1,67 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+#include "document.h"
+#include "pattern.h"
+
+// 문서 전체 문자열 검색
+// 시작할 때 문서 스냅샷을 떠 두고 블록 단위로 훑으며, 찾은 위치(바이트 오프셋)를 오름차순 색인에 쌓는다.
+// 조금씩(search_step) 훑을 수 있어 큰 파일에서도 첫 결과를 바로 보여 줄 수 있고,
+// 다음/이전 결과는 색인에서 이분 탐색으로 찾는다. 겹치는 결과도 시작 위치마다 하나씩 센다
+// (그래서 검색어 뒤에 글자를 붙이면 새 결과는 늘 앞 결과의 부분집합이다).
+// 큰 문서는 코어 수만큼의 스레드가 조각을 나눠 훑고, search_step 은 앞 조각부터 끝난 결과를 색인에 옮긴다
+// (그래서 앞쪽 결과는 뒤 조각을 훑는 동안에도 나온다).
+typedef struct search search;
+
+search* search_new(void);
+void search_free(search* s);
+
+// doc 의 지금 내용에서 query[0, len) 을 찾기 시작한다. 이전 결과는 버린다 (doc 의 잠금을 쥐고 부를 것)
+// 실패하거나 len 이 0 이면 -1
+int search_start(search* s, document* doc, const char* query, size_t len);
+// 문자열 대신 정규식 p 로 찾기 시작한다 (p 는 검색이 끝날 때까지 쥐고 있는다)
+// 결과는 앞에서부터 겹치지 않게 고른 일치의 시작 위치들이다 (doc 의 잠금을 쥐고 부를 것). 실패 시 -1
+int search_start_pattern(search* s, document* doc, pattern* p);
+// 지금 검색어 뒤에 글자를 붙인 query 로 좁힌다. 이미 찾은 자리만 다시 확인하고,
+// 아직 훑지 않은 곳은 새 검색어로 이어서 훑는다. 이어 붙인 검색어가 아니거나 정규식 검색이었거나 문서가 바뀌었으면
+// search_start 와 같다 (doc 의 잠금을 쥐고 부를 것). 실패 시 -1
+int search_refine(search* s, document* doc, const char* query, size_t len);
+// 결과를 버리고 검색을 끝낸다
+void search_clear(search* s);
+int search_active(search* s);
+
+// 최대 limit 바이트를 더 훑는다 (스레드들이 훑는 중이면 끝난 조각을 옮기고, 옮길 것이 없으면 하나가 끝날 때까지
+// 기다린다). 끝까지 훑었으면 1, 아직 남았으면 0, 실패 시 -1
+int search_step(search* s, size_t limit);
+int search_done(search* s);
+
+long search_count(search* s);           // 지금까지 찾은 개수
+size_t search_match(search* s, long i); // i 번째 결과의 시작 오프셋
+size_t search_length(search* s);        // 찾는 문자열 길이
+const char* search_query(search* s);    // 찾는 문자열 또는 정규식 원문 (끝에 0)
+int search_is_pattern(search* s);
+pattern* search_pattern(search* s);     // 정규식 검색이 아니면 NULL
+unsigned long search_version(search* s); // 검색한 문서의 doc_version
+
+// 지금까지 찾은 결과 중 off 이후(off 포함)에서 시작하는 첫 번호. 없으면 search_count
+// (아직 훑지 않은 곳은 보지 않는다)
+long search_find(search* s, size_t off);
+// off 이후(off 포함)에서 시작하는 첫 결과 번호. 뒤에 없으면 처음으로 돌아간다
+// 아직 훑지 않은 곳은 필요한 만큼 더 훑는다. 결과가 하나도 없으면 -1
+long search_next(search* s, size_t off);
+// off 앞에서 시작하는 마지막 결과 번호. 앞에 없으면 끝으로 돌아간다
+long search_prev(search* s, size_t off);
+
+// data[from, to) 안에서 지금 검색어가 시작하는 첫 위치 (없으면 to) 와 그 길이 *len. 화면에 결과를 칠할 때 쓴다
+size_t search_find_in(search* s, const char* data, size_t from, size_t to, size_t* len);
+// data[from, to) 안에서 query[0, len) 이 시작하는 첫 위치 (없으면 to). 검색 객체 없이 쓰는 문자열 찾기
+size_t search_find_literal(const char* data, size_t from, size_t to, const char* query, size_t len);
+
+// 지금 검색어의 결과를 doc 에서 모두 repl[0, rlen) 으로 바꾸고 검색을 끝낸다. 정규식이면 repl 의 \0..\9 를 펼친다.
+// 문서를 새로 훑어 겹치지 않는 결과를 앞에서부터 고르고, 첫 결과부터 마지막 결과까지를 삽입 하나와 삭제 하나로
+// 바꾸므로 편집 알림(저널, 구문 강조 무효화)도 한 번씩만 간다. 바꾼 개수, 실패 시 -1 (doc 의 잠금을 쥐고 부를 것)
+long search_replace_all(search* s, document* doc, const char* repl, size_t rlen);
+
+#endif
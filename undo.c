@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "undo.h"
+
+#define UNDO_MAGIC "CEUNDO2\n"
+
+// 지우는 글자를 앞 기록에 붙이는 것은 기록이 이만큼 될 때까지 (앞에 끼워 넣느라 옮기는 양을 묶는다)
+#define UNDO_MERGE_MAX 4096
+
+// 기록 하나: 머리 + 삭제면 지운 내용 + 꼬리 (기록 전체 길이. 끝에서부터 거슬러 읽으려고)
+// 기록은 파일에도 그대로 쓰므로 머리와 꼬리는 틈(padding) 없는 64비트 필드로만 만든다
+struct rec {
+    uint64_t step;
+    uint64_t off;
+    uint64_t len;
+    uint64_t op;                // DOC_EDIT_INSERT / DOC_EDIT_DELETE
+};
+#define REC_TAIL sizeof(uint64_t)
+
+// 기록을 차례로 쌓는 아레나. buf[head, tail) 에 기록이 있고, 끝에 붙이고 끝에서 빼며 오래된 것은 앞에서 버린다
+struct log {
+    char* buf;
+    size_t head, tail, cap;
+};
+
+// 기록 파일의 머리. 뒤에 되돌리기 기록이 메모리에서와 같은 모양으로 이어진다
+struct undo_header {
+    char magic[8];
+    uint64_t hash;              // 기록이 끝나는 내용 (남길 때의 문서) 의 해시
+    uint64_t length;            // 그 내용의 길이
+    uint64_t step;              // 마지막 단계 번호 (다음 세션의 번호가 겹치지 않게)
+    uint64_t bytes;             // 기록 바이트
+};
+
+struct undo {
+    struct log saved;           // 지난 세션에서 남긴 기록 (done 보다 앞선 단계들). buf 는 매핑 안을 가리킨다
+    void* map;
+    size_t map_len;
+    document* base;             // 불러올 때의 문서 사본. 처음 saved 를 쓸 때 내용이 기록과 맞는지 보고 놓는다
+    uint64_t hash;
+    struct log done;            // 되돌릴 수 있는 편집
+    struct log undone;          // 다시 할 수 있는 편집
+    struct log* target;         // 편집 알림을 적을 곳 (되돌리는 동안은 undone, 다시 하는 동안은 done)
+    size_t budget;
+    unsigned long step;         // 마지막으로 쓴 단계 번호
+    unsigned long applying;     // 되돌리거나 다시 하는 중인 단계 (아니면 0)
+    int depth;                  // undo_begin 이 겹친 수
+    int chosen;                 // 이번 묶음이 들어갈 단계를 정했다
+    int typing;                 // 이번 묶음이 모두 글자 하나 넣기/지우기였다
+    int open;                   // 다음 입력이 마지막 단계에 붙을 수 있다
+    int dropped;                // 적던 단계가 예산을 넘어 버려졌다 (그 단계의 나머지도 적지 않는다)
+};
+
+static size_t rec_size(const struct rec* r) {
+    return sizeof(*r) + (r->op == DOC_EDIT_DELETE ? r->len : 0) + REC_TAIL;
+}
+
+static size_t log_bytes(const struct log* l) {
+    return l->tail - l->head;
+}
+
+static void log_clear(struct log* l) {
+    free(l->buf);
+    memset(l, 0, sizeof(*l));
+}
+
+// 끝에 need 바이트를 붙일 자리를 만든다. 앞에서 버린 자리는 모아서 다시 쓰되,
+// 모은 뒤에도 절반 넘게 차 있으면 늘려서 옮기는 일이 붙이는 양에 비례하게 한다
+static int log_reserve(struct log* l, size_t need) {
+    if (l->tail + need <= l->cap) return 0;
+    size_t used = log_bytes(l);
+    if (l->head) {
+        memmove(l->buf, l->buf + l->head, used);
+        l->head = 0;
+        l->tail = used;
+    }
+    if (used + need <= l->cap / 2) return 0;
+    size_t cap = l->cap ? l->cap : 4096;
+    while (cap < 2 * (used + need)) cap *= 2;
+    char* buf = realloc(l->buf, cap);
+    if (!buf) return -1;
+    l->buf = buf;
+    l->cap = cap;
+    return 0;
+}
+
+static int log_push(struct log* l, const struct rec* r, const char* text) {
+    uint64_t size = rec_size(r);
+    if (log_reserve(l, size) < 0) return -1;
+    char* p = l->buf + l->tail;
+    memcpy(p, r, sizeof(*r));
+    if (r->op == DOC_EDIT_DELETE) memcpy(p + sizeof(*r), text, r->len);
+    memcpy(p + size - REC_TAIL, &size, REC_TAIL);
+    l->tail += size;
+    return 0;
+}
+
+// 마지막 기록의 머리를 r 에 담고 시작 위치를 돌려준다. 비었으면 NULL
+static char* log_last(const struct log* l, struct rec* r) {
+    if (l->tail == l->head) return NULL;
+    uint64_t size;
+    if (log_bytes(l) < REC_TAIL) return NULL;
+    memcpy(&size, l->buf + l->tail - REC_TAIL, REC_TAIL);
+    // 파일에서 불러온 기록은 깨져 있을 수 있으므로 모양을 확인한다
+    if (size < sizeof(*r) + REC_TAIL || size > log_bytes(l)) return NULL;
+    char* p = l->buf + l->tail - size;
+    memcpy(r, p, sizeof(*r));
+    if ((r->op != DOC_EDIT_INSERT && r->op != DOC_EDIT_DELETE) || rec_size(r) != size) return NULL;
+    return p;
+}
+
+static int log_first(const struct log* l, struct rec* r) {
+    if (log_bytes(l) < sizeof(*r)) return 0;
+    memcpy(r, l->buf + l->head, sizeof(*r));
+    return rec_size(r) <= log_bytes(l);
+}
+
+// 맨 앞 단계의 기록을 모두 버린다
+static void log_drop_step(struct log* l) {
+    struct rec r;
+    if (!log_first(l, &r)) return;
+    uint64_t step = r.step;
+    while (log_first(l, &r) && r.step == step) l->head += rec_size(&r);
+}
+
+// 마지막 기록 (머리 r) 의 지운 내용 앞이나 뒤에 text 를 붙인다
+static int log_grow_delete(struct log* l, struct rec* r, const char* text, size_t len, int front) {
+    if (log_reserve(l, len) < 0) return -1;
+    char* p = l->buf + l->tail - rec_size(r);     // 자리를 만들며 옮겼을 수 있다
+    char* payload = p + sizeof(*r);
+    if (front) memmove(payload + len, payload, r->len);
+    memcpy(front ? payload : payload + r->len, text, len);
+    if (front) r->off -= len;
+    r->len += len;
+    uint64_t size = rec_size(r);
+    memcpy(p, r, sizeof(*r));
+    memcpy(p + size - REC_TAIL, &size, REC_TAIL);
+    l->tail += len;
+    return 0;
+}
+
+// 이어서 치거나 지우는 글자인가 (앞 기록 last 에 붙일 수 있는가)
+static int continues(const struct rec* last, int op, size_t off, size_t len) {
+    if (last->op != op) return 0;
+    if (op == DOC_EDIT_INSERT) return last->off <= off && off <= last->off + last->len;
+    return off + len == last->off || off == last->off;
+}
+
+static void drop_saved(undo* u) {
+    if (u->map) munmap(u->map, u->map_len);
+    doc_free(u->base);
+    memset(&u->saved, 0, sizeof(u->saved));
+    u->map = NULL;
+    u->base = NULL;
+}
+
+// 내용 해시. 8바이트씩 섞으므로 조각이 어떻게 나뉘어 있든 같은 내용이면 같은 값이다
+struct hasher {
+    uint64_t h, word;
+    size_t total;
+};
+
+static void mix(struct hasher* s, uint64_t w) {
+    s->h = (s->h ^ w) * 0x9E3779B97F4A7C15ull;
+    s->h ^= s->h >> 32;
+}
+
+static int hash_chunk(const char* data, size_t len, void* arg) {
+    struct hasher* s = arg;
+    for (; len > 0 && s->total % 8; data++, len--) {
+        s->word |= (uint64_t)(unsigned char)*data << (8 * (s->total % 8));
+        if (++s->total % 8 == 0) {
+            mix(s, s->word);
+            s->word = 0;
+        }
+    }
+    for (; len >= 8; data += 8, len -= 8, s->total += 8) {
+        uint64_t w;
+        memcpy(&w, data, 8);
+        mix(s, w);
+    }
+    for (; len > 0; data++, len--, s->total++) s->word |= (uint64_t)(unsigned char)*data << (8 * (s->total % 8));
+    return 0;
+}
+
+static uint64_t content_hash(document* doc) {
+    struct hasher s = {0xcbf29ce484222325ull, 0, 0};
+    doc_foreach_chunk(doc, hash_chunk, &s);
+    mix(&s, s.word);
+    mix(&s, s.total);
+    return s.h;
+}
+
+// 불러온 기록이 불러올 때의 내용에서 끝나는지 처음 쓸 때 확인한다. 맞지 않으면 버린다. 쓸 수 있으면 0
+static int check_saved(undo* u) {
+    if (!u->base) return log_bytes(&u->saved) ? 0 : -1;
+    int ok = content_hash(u->base) == u->hash;
+    doc_free(u->base);
+    u->base = NULL;
+    if (!ok) drop_saved(u);
+    return ok ? 0 : -1;
+}
+
+// 기록이 예산을 넘으면 오래된 단계부터 버린다. 지금 적거나 적용하는 단계는 남기고,
+// 그것만 남았는데도 넘으면 적던 단계를 버린다 (그 단계는 되돌릴 수 없게 된다)
+static void trim(undo* u, unsigned long writing) {
+    while (undo_bytes(u) > u->budget) {
+        struct log* logs[3] = {&u->saved, &u->done, &u->undone};
+        int dropped = 0;
+        for (int i = 0; i < 3 && !dropped; i++) {
+            struct rec r;
+            if (!log_first(logs[i], &r) || r.step == writing || (u->applying && r.step == u->applying)) continue;
+            log_drop_step(logs[i]);
+            dropped = 1;
+        }
+        if (dropped) continue;
+        // 남은 것이 적던 단계뿐이다. 적던 기록은 마지막 단계라 끝에서부터 걷어 낸다
+        struct rec r;
+        while (log_last(u->target, &r) && r.step == writing) u->target->tail -= rec_size(&r);
+        u->dropped = 1;
+        break;
+    }
+}
+
+undo* undo_new(size_t budget) {
+    undo* u = calloc(1, sizeof(*u));
+    if (!u) return NULL;
+    u->target = &u->done;
+    u->budget = budget;
+    return u;
+}
+
+void undo_free(undo* u) {
+    if (!u) return;
+    drop_saved(u);
+    log_clear(&u->done);
+    log_clear(&u->undone);
+    free(u);
+}
+
+void undo_clear(undo* u) {
+    drop_saved(u);
+    log_clear(&u->done);
+    log_clear(&u->undone);
+    u->open = 0;
+}
+
+void undo_set_budget(undo* u, size_t budget) {
+    u->budget = budget;
+    trim(u, 0);
+}
+
+size_t undo_budget(undo* u) {
+    return u->budget;
+}
+
+size_t undo_bytes(undo* u) {
+    return log_bytes(&u->saved) + log_bytes(&u->done) + log_bytes(&u->undone);
+}
+
+void undo_record(undo* u, int op, size_t off, const char* text, size_t len) {
+    if (!u || len == 0) return;
+    struct log* l = u->target;
+    struct rec last;
+    char* p = log_last(l, &last);
+
+    if (!u->applying) {
+        log_clear(&u->undone);
+        // 글자 하나(괄호 짝이나 \r\n 이면 둘)를 넣거나 지우는 것만 앞 단계에 이어 붙인다
+        int typing = len <= 2 && (op == DOC_EDIT_DELETE || !memchr(text, '\n', len));
+        if (!u->depth || !u->chosen) {
+            if (!(u->open && typing && p && last.step == u->step && continues(&last, op, off, len))) {
+                u->step++;
+                u->dropped = 0;
+            }
+            u->chosen = 1;
+        }
+        if (u->depth) u->typing &= typing;
+        else u->open = typing;
+    }
+    if (u->dropped) return;
+
+    // 같은 단계에서 이어지는 글자는 기록 하나로 합친다
+    int rc = -1;
+    if (p && last.step == u->step && last.op == op) {
+        if (op == DOC_EDIT_INSERT && off == last.off + last.len) {
+            last.len += len;
+            memcpy(p, &last, sizeof(last));
+            rc = 0;
+        } else if (op == DOC_EDIT_DELETE && last.len + len <= UNDO_MERGE_MAX &&
+                   (off + len == last.off || off == last.off)) {
+            rc = log_grow_delete(l, &last, text, len, off + len == last.off);
+        }
+    }
+    if (rc < 0) {
+        struct rec r = {u->step, off, len, op};
+        if (log_push(l, &r, text) < 0) {
+            // 적지 못한 편집이 끼면 이 단계도, 그보다 앞선 단계도 제자리에 되돌릴 수 없다
+            log_clear(l);
+            if (l == &u->done) drop_saved(u);
+            u->dropped = 1;
+            return;
+        }
+    }
+    trim(u, u->step);
+}
+
+void undo_begin(undo* u) {
+    if (u->depth++ == 0) {
+        u->chosen = 0;
+        u->typing = 1;
+    }
+}
+
+void undo_end(undo* u) {
+    if (--u->depth > 0) return;
+    if (u->chosen) u->open = u->typing;
+}
+
+void undo_seal(undo* u) {
+    u->open = 0;
+}
+
+// from 의 마지막 단계를 반대로 적용한다. 적용하며 나오는 편집 알림은 to 에 새 단계로 적힌다
+static int apply(undo* u, struct log* from, struct log* to, document* doc, size_t* cursor) {
+    struct rec r;
+    if (!log_last(from, &r)) return 0;
+    u->applying = r.step;
+    u->target = to;
+    u->step++;
+    u->dropped = 0;
+    u->open = 0;
+    int ret = 1;
+    char* p;
+    while ((p = log_last(from, &r)) && r.step == u->applying) {
+        int rc;
+        if (r.op == DOC_EDIT_INSERT) {
+            rc = doc_delete(doc, r.off, r.len);
+            *cursor = r.off;
+        } else {
+            rc = doc_insert(doc, r.off, p + sizeof(r), r.len);
+            *cursor = r.off + r.len;
+        }
+        if (rc < 0) {
+            ret = -1;
+            break;
+        }
+        from->tail -= rec_size(&r);
+    }
+    u->applying = 0;
+    u->target = &u->done;
+    return ret;
+}
+
+int undo_undo(undo* u, document* doc, size_t* cursor) {
+    // 이번 세션의 기록을 다 되돌렸으면 지난 세션의 기록으로 이어 간다
+    if (!log_bytes(&u->done) && check_saved(u) == 0) return apply(u, &u->saved, &u->undone, doc, cursor);
+    return apply(u, &u->done, &u->undone, doc, cursor);
+}
+
+int undo_redo(undo* u, document* doc, size_t* cursor) {
+    return apply(u, &u->undone, &u->done, doc, cursor);
+}
+
+void undo_history_path(const char* path, char* out, size_t n) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    snprintf(out, n, "%.*s.%s.undo", dir_len, path, path + dir_len);
+}
+
+int undo_save(undo* u, const char* path, document* doc) {
+    char side[4096], tmp[4200];
+    undo_history_path(path, side, sizeof(side));
+    if (u->base) check_saved(u);        // 확인하지 않은 기록을 새 해시로 묶어 남기지 않게
+    size_t bytes = log_bytes(&u->saved) + log_bytes(&u->done);
+    if (bytes == 0) {
+        unlink(side);
+        return 0;
+    }
+
+    struct undo_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, UNDO_MAGIC, 8);
+    h.hash = content_hash(doc);
+    h.length = doc_length(doc);
+    h.step = u->step;
+    h.bytes = bytes;
+    struct iovec iov[3] = {
+        {&h, sizeof(h)},
+        {u->saved.buf + u->saved.head, log_bytes(&u->saved)},
+        {u->done.buf + u->done.head, log_bytes(&u->done)},
+    };
+
+    // 불러온 기록이 매핑된 채로 덮어쓰지 않도록 새 파일에 써서 바꿔 끼운다
+    snprintf(tmp, sizeof(tmp), "%s.tmp", side);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+    size_t want = sizeof(h) + bytes;
+    ssize_t n = writev(fd, iov, 3);
+    if (close(fd) < 0 || n != (ssize_t)want || rename(tmp, side) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int undo_load(undo* u, const char* path, document* doc) {
+    char side[4096];
+    undo_history_path(path, side, sizeof(side));
+    int fd = open(side, O_RDONLY);
+    if (fd < 0) return 0;
+    struct undo_header h;
+    struct stat st;
+    void* map = MAP_FAILED;
+    int ok = fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(h) && pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+             memcmp(h.magic, UNDO_MAGIC, 8) == 0 && sizeof(h) + h.bytes == (uint64_t)st.st_size;
+    // 길이가 다르면 파일이 밖에서 바뀐 것이다. 길이가 같으면 해시는 처음 되돌릴 때 확인한다
+    if (ok && h.length == doc_length(doc)) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        if (ok) unlink(side);
+        return 0;
+    }
+
+    drop_saved(u);
+    u->map = map;
+    u->map_len = st.st_size;
+    u->saved.buf = (char*)map + sizeof(h);
+    u->saved.tail = h.bytes;
+    u->hash = h.hash;
+    u->base = doc_snapshot(doc);
+    if (h.step > u->step) u->step = h.step;
+    if (!u->base) drop_saved(u);
+    trim(u, 0);
+    return u->map != NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stddef.h>
+
+#include "document.h"
+
+// 되돌리기/다시 하기
+// 문서의 편집 알림을 받아 연산을 바이트 아레나 하나에 차례로 적어 둔다. 삽입은 위치와 길이만,
+// 삭제는 위치와 지운 내용만 적고, 되돌릴 때는 끝에서부터 반대 연산을 적용한다.
+// 그래서 비용은 되돌리는 편집의 크기에만 비례한다 (붙여 넣은 5만 줄을 되돌려도 문서를 복사하지 않는다).
+// 연산은 단계로 묶는다. undo_begin/undo_end 사이의 편집은 한 단계이고, 이어서 치는 글자나
+// 연달아 지우는 글자는 앞 단계에 붙는다. 기록이 예산을 넘으면 가장 오래된 단계부터 버린다.
+typedef struct undo undo;
+
+#define UNDO_BUDGET (64 * 1024 * 1024)  // 기본 예산 (되돌리기와 다시 하기 기록을 합친 바이트)
+
+undo* undo_new(size_t budget);
+void undo_free(undo* u);
+void undo_clear(undo* u);               // 기록을 모두 버린다 (다른 문서를 열었을 때)
+void undo_set_budget(undo* u, size_t budget);
+size_t undo_budget(undo* u);
+size_t undo_bytes(undo* u);             // 지금 기록이 차지하는 바이트
+
+// 편집 알림 (doc_edit_fn 과 같은 인자). 새 편집이 들어오면 다시 하기 기록은 버린다
+void undo_record(undo* u, int op, size_t off, const char* text, size_t len);
+
+// undo_begin 과 undo_end 사이의 편집을 한 단계로 묶는다 (겹쳐 불러도 된다)
+void undo_begin(undo* u);
+void undo_end(undo* u);
+// 다음 편집은 앞 단계에 붙이지 않는다 (커서를 옮겼을 때)
+void undo_seal(undo* u);
+
+// 한 단계를 되돌린다/다시 한다. 마지막으로 고친 자리를 *cursor 에 담는다 (doc 의 잠금을 쥐고 부를 것)
+// 했으면 1, 할 것이 없으면 0, 메모리가 모자라 도중에 멈췄으면 -1
+int undo_undo(undo* u, document* doc, size_t* cursor);
+int undo_redo(undo* u, document* doc, size_t* cursor);
+
+// 되돌리기 기록은 파일 옆의 ".이름.undo" 에 남겨 다음에 열 때 이어 쓴다.
+// 기록은 doc 의 지금 내용(해시와 길이)에 묶이므로 파일이 밖에서 바뀌었으면 버려진다
+void undo_history_path(const char* path, char* out, size_t n);
+// 지금까지의 되돌리기 기록을 남긴다 (다시 하기 기록은 남기지 않는다). 남길 것이 없으면 기록 파일을 지운다
+// 실패 시 -1 (doc 의 잠금을 쥐고 부를 것)
+int undo_save(undo* u, const char* path, document* doc);
+// path 의 기록을 이번 기록 앞에 붙인다. 파일은 mmap 만 하고 머리만 읽으므로 기록 길이와 무관하게 빠르며,
+// 내용이 맞는지는 처음 거기까지 되돌릴 때 확인한다. 붙였으면 1 (doc 의 잠금을 쥐고 부를 것)
+int undo_load(undo* u, const char* path, document* doc);
+
+#endif